@@ -26,14 +26,62 @@ limitations under the License.
 // Selective instrumentation environment variable
 #define SALT_FORTRAN_SELECT_FILE_VAR "SALT_FORTRAN_SELECT_FILE"
 
+// Phase timing environment variable: "1" prints a table to stderr,
+// any other value names a JSON file to write the report to
+#define SALT_FORTRAN_TIME_REPORT_VAR "SALT_FORTRAN_TIME_REPORT"
+
+// Chrome trace environment variable, read like SALT_FORTRAN_TIME_REPORT_VAR;
+// "1" writes the default file name
+#define SALT_FORTRAN_TIME_TRACE_VAR "SALT_FORTRAN_TIME_TRACE"
+#define SALT_FORTRAN_TIME_TRACE_DEFAULT_NAME "salt-fm"
+#define SALT_FORTRAN_TIME_TRACE_GRANULARITY 500 // microseconds
+
+// Size thresholds, read like the cparse-llvm options --salt_min_statements,
+// --salt_min_nodes, --salt_min_lines and --salt_skip_leaf; unset or 0 disables
+#define SALT_FORTRAN_MIN_STATEMENTS_VAR "SALT_FORTRAN_MIN_STATEMENTS"
+#define SALT_FORTRAN_MIN_NODES_VAR "SALT_FORTRAN_MIN_NODES"
+#define SALT_FORTRAN_MIN_LINES_VAR "SALT_FORTRAN_MIN_LINES"
+#define SALT_FORTRAN_SKIP_LEAF_VAR "SALT_FORTRAN_SKIP_LEAF"
+
+// Size report environment variable, read like SALT_FORTRAN_TIME_REPORT_VAR:
+// "1" prints the procedures skipped for their size to stderr
+#define SALT_FORTRAN_SIZE_REPORT_VAR "SALT_FORTRAN_SIZE_REPORT"
+
+// Profile-guided exclusion, read like the cparse-llvm options --salt_profile,
+// --salt_reduce_rule and --salt_reduce_output; several profiles or rules are
+// separated by ';'
+#define SALT_FORTRAN_PROFILE_VAR "SALT_FORTRAN_PROFILE"
+#define SALT_FORTRAN_REDUCE_RULES_VAR "SALT_FORTRAN_REDUCE_RULES"
+#define SALT_FORTRAN_REDUCE_OUTPUT_VAR "SALT_FORTRAN_REDUCE_OUTPUT"
+
+// Timer ID mode, like the cparse-llvm option --salt_timer_ids: unset, empty
+// or 0 emits full timer names
+#define SALT_FORTRAN_TIMER_IDS_VAR "SALT_FORTRAN_TIMER_IDS"
+
+// Throttling guard, read like the cparse-llvm options --salt_throttle,
+// --salt_throttle_calls and --salt_throttle_usec; unset, empty or 0 leaves
+// the probes unguarded
+#define SALT_FORTRAN_THROTTLE_VAR "SALT_FORTRAN_THROTTLE"
+#define SALT_FORTRAN_THROTTLE_CALLS_VAR "SALT_FORTRAN_THROTTLE_CALLS"
+#define SALT_FORTRAN_THROTTLE_USEC_VAR "SALT_FORTRAN_THROTTLE_USEC"
+#define SALT_FORTRAN_THROTTLE_DEFAULT_CALLS 100000
+#define SALT_FORTRAN_THROTTLE_DEFAULT_USEC 10.0
+
+// Instrumentation groups, read like the cparse-llvm options --salt_groups and
+// --salt_group_small; unset, empty or 0 leaves the probes unwrapped
+#define SALT_FORTRAN_GROUPS_VAR "SALT_FORTRAN_GROUPS"
+#define SALT_FORTRAN_GROUP_SMALL_VAR "SALT_FORTRAN_GROUP_SMALL"
+
 // Configuration file YAML keys
 #define SALT_FORTRAN_KEY "Fortran"
 #define SALT_FORTRAN_PROGRAM_BEGIN_KEY "program_insert"
 #define SALT_FORTRAN_PROCEDURE_BEGIN_KEY "procedure_begin_insert"
 #define SALT_FORTRAN_PROCEDURE_END_KEY "procedure_end_insert"
 
-// Configuration file template replacement strings
-#define SALT_FORTRAN_TIMER_NAME_TEMPLATE R"(\$\{full_timer_name\})"
+// Configuration file template placeholders, written as ${name}
+#define SALT_FORTRAN_TIMER_NAME_PLACEHOLDER "full_timer_name"
+#define SALT_FORTRAN_TIMER_INDEX_PLACEHOLDER "timer_index"
+#define SALT_FORTRAN_TIMER_TABLE_PLACEHOLDER "timer_table"
 
 // Fortran line splitting
 #define SALT_FORTRAN_STRING_SPLITTER "&\n     &"
@@ -17,10 +17,16 @@ limitations under the License.
 #define FLANG_INSTRUMENTATION_POINT_HPP
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <optional>
 #include <utility>
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "snippet_template.hpp"
+
 namespace salt::fortran {
     enum class InstrumentationPointType {
         PROGRAM_BEGIN, // Declare profiler, initialize TAU, set node, start timer
@@ -36,7 +42,13 @@ namespace salt::fortran {
         REPLACE
     };
 
-    using InstrumentationMap = std::map<InstrumentationPointType, const std::string>;
+    // The configured text of each instrumentation point type, compiled once
+    // per process with the placeholders below
+    using InstrumentationMap = std::map<InstrumentationPointType, const salt::SnippetTemplate>;
+
+    // Placeholders of the begin templates, in the order
+    // salt::SnippetTemplate::expand() takes their values
+    [[nodiscard]] llvm::ArrayRef<llvm::StringRef> instrumentationPlaceholders();
 
     class InstrumentationPoint {
     public:
@@ -80,19 +92,31 @@ namespace salt::fortran {
         [[nodiscard]] virtual std::string toString() const;
 
         [[nodiscard]] virtual std::string instrumentationString(const InstrumentationMap &instMap,
-                                                                const std::string &lineText) const;
+                                                                std::string_view lineText) const;
+
+        // The $SALT_FORTRAN_GROUPS macro, e.g. SALT_GROUP_LEAF, whose #if
+        // wraps the probe text; empty leaves it unwrapped
+        void setGroup(std::string group) {
+            group_ = std::move(group);
+        }
+
+    protected:
+        [[nodiscard]] std::string grouped(std::string text) const;
 
     private:
         const InstrumentationPointType instrumentationType_;
         const int line_;
         const InstrumentationLocation location_;
+        std::string group_;
     };
 
     class ProgramBeginInstrumentationPoint final : public InstrumentationPoint {
     public:
-        ProgramBeginInstrumentationPoint(const int line, std::string timerName) : InstrumentationPoint(
+        ProgramBeginInstrumentationPoint(const int line, std::string timerName, std::string timerIndex,
+                                         std::string timerTable) : InstrumentationPoint(
                 InstrumentationPointType::PROGRAM_BEGIN, line, InstrumentationLocation::BEFORE),
-            timerName_(std::move(timerName)) {
+            timerName_(std::move(timerName)), timerIndex_(std::move(timerIndex)),
+            timerTable_(std::move(timerTable)) {
         }
 
         [[nodiscard]] std::string timerName() const {
@@ -102,19 +126,24 @@ namespace salt::fortran {
         [[nodiscard]] std::string toString() const override;
 
         [[nodiscard]] std::string instrumentationString(const InstrumentationMap &instMap,
-                                                        const std::string &lineText) const override;
+                                                        std::string_view lineText) const override;
 
     private:
         const std::string timerName_;
+        // ${timer_index} and ${timer_table}
+        const std::string timerIndex_;
+        const std::string timerTable_;
     };
 
     class ProcedureBeginInstrumentationPoint final : public InstrumentationPoint {
     public:
-        ProcedureBeginInstrumentationPoint(const int line, std::string timerName) : InstrumentationPoint(
+        ProcedureBeginInstrumentationPoint(const int line, std::string timerName, std::string timerIndex,
+                                           std::string timerTable) : InstrumentationPoint(
                 InstrumentationPointType::PROCEDURE_BEGIN,
                 line,
                 InstrumentationLocation::BEFORE),
-            timerName_(std::move(timerName)) {
+            timerName_(std::move(timerName)), timerIndex_(std::move(timerIndex)),
+            timerTable_(std::move(timerTable)) {
         }
 
         [[nodiscard]] std::string timerName() const {
@@ -124,10 +153,13 @@ namespace salt::fortran {
         [[nodiscard]] std::string toString() const override;
 
         [[nodiscard]] std::string instrumentationString(const InstrumentationMap &instMap,
-                                                        const std::string &lineText) const override;
+                                                        std::string_view lineText) const override;
 
     private:
         const std::string timerName_;
+        // ${timer_index} and ${timer_table}
+        const std::string timerIndex_;
+        const std::string timerTable_;
     };
 
     class ProcedureEndInstrumentationPoint final : public InstrumentationPoint {
@@ -188,7 +220,7 @@ namespace salt::fortran {
         [[nodiscard]] std::string toString() const override;
 
         [[nodiscard]] std::string instrumentationString(const InstrumentationMap &instMap,
-                                                        const std::string &lineText) const override;
+                                                        std::string_view lineText) const override;
 
     private:
         const int endLine_;
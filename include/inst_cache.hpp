@@ -0,0 +1,47 @@
+#ifndef INST_CACHE_H
+#define INST_CACHE_H
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/CommandLine.h"
+#include <atomic>
+#include <string>
+
+extern llvm::cl::opt<std::string> cachedir;
+
+// One cached instrumented file. The header line stores whether the source was
+// instrumented or copied through, and the name of the instrumentation.
+typedef struct inst_cache_entry {
+    bool instrumented = false;
+    std::string instrumentation;
+    std::string content;
+} inst_cache_entry;
+
+// ccache-style store of instrumented outputs. The key covers everything that
+// can change what instrument() writes for a source: the raw and preprocessed
+// source, the compile command, the config and select files, the options that
+// affect rewriting and the SALT-FM/LLVM versions. A hit only needs a
+// preprocessor pass, never an AST.
+class inst_cache {
+public:
+    explicit inst_cache(std::string dir);
+
+    // Computes the key for source. Returns false if the source could not be
+    // read or preprocessed, in which case it must not be cached.
+    bool compute_key(const clang::tooling::CompilationDatabase &compilations, const std::string &source,
+                     bool cxx_api, std::string &key) const;
+
+    bool lookup(const std::string &key, inst_cache_entry &entry);
+
+    void store(const std::string &key, const inst_cache_entry &entry) const;
+
+    void print_stats() const;
+
+private:
+    std::string entry_path(const std::string &key) const;
+
+    std::string dir;
+    std::atomic<unsigned> hits{0};
+    std::atomic<unsigned> misses{0};
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef INST_SERVER_H
+#define INST_SERVER_H
+
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern llvm::cl::opt<std::string> servesocket;
+
+// Runs one cparse-llvm command line in the calling process and returns its exit status
+typedef llvm::function_ref<int(int argc, const char **argv)> request_handler;
+
+// Socket of the server the client side talks to: $SALT_SERVER_SOCKET if set
+// (empty disables forwarding), otherwise a per-user, per-version default.
+std::string server_socket_path();
+
+// Serves requests on socket_path one at a time until the process is killed.
+// Each request runs handler in the client's working directory and with the
+// client's stdout and stderr, which are passed over the socket.
+int run_server(const std::string &socket_path, request_handler handler);
+
+// Sends argv to the server on socket_path and waits for its exit status.
+// Returns false, having done nothing, if no server answers there or the one
+// that does runs as another user.
+bool forward_to_server(const std::string &socket_path, int argc, const char **argv, int &status);
+
+// Status and contents of the files under a fixed set of system include
+// directories. Every ClangTool of the process (a whole batch, or a server's
+// lifetime) reads them through one cache instead of stat-ing and reading them
+// for every translation unit. An entry is trusted until revalidate(), after
+// which its next use stats the file again and rereads it if its modification
+// time or size changed, e.g. after a system or toolchain upgrade.
+class header_cache {
+public:
+    explicit header_cache(std::vector<std::string> dirs);
+
+    // A physical file system with its own working directory that serves the
+    // cached directories from this cache
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> file_system();
+
+    bool covers(llvm::StringRef path) const;
+
+    // Makes every entry check its file again before it is used; a server
+    // calls this before each request, while no tool is reading the cache
+    void revalidate();
+
+    llvm::ErrorOr<llvm::vfs::Status> status(llvm::StringRef path, llvm::vfs::FileSystem &fs);
+
+    // Returns the cached contents of path; buffer is null if it cannot be read
+    llvm::ErrorOr<llvm::vfs::Status> read(llvm::StringRef path, llvm::vfs::FileSystem &fs,
+                                          const llvm::MemoryBuffer *&buffer);
+
+private:
+    typedef struct entry {
+        std::error_code error;
+        llvm::vfs::Status status;
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+        // Value of generation when the file was last checked
+        unsigned checked = 0;
+    } entry;
+
+    std::vector<std::string> dirs;
+    std::mutex mutex;
+    llvm::StringMap<entry> entries;
+    unsigned generation = 1;
+    // Contents replaced since the last revalidate(); open files may still refer to them
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> stale;
+};
+
+#endif
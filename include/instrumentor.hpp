@@ -3,8 +3,20 @@
 
 #include <ryml_all.hpp>
 #include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
 #include <vector>
 #include <set>
+#include <memory>
+#include <mutex>
+
+#include "select_matcher.hpp"
+#include "size_filter.hpp"
+#include "snippet_template.hpp"
+#include "time_report.hpp"
 
 /* defines */
 #ifdef TAU_WINDOWS
@@ -13,12 +25,15 @@
 #define TAU_DIR_CHARACTER '/'
 #endif /* TAU_WINDOWS */
 
-// make sure begin func comes before returns and such
+// make sure begin func comes before returns and such, and that a loop ends
+// before what follows it at the same place begins (or the function ends)
 #define BEGIN_FUNC 0
-#define RETURN_FUNC 1
-#define MULTILINE_RETURN_FUNC 2
-#define EXIT_FUNC 3
-#define NUM_LOC_TYPES 4
+#define END_LOOP 1
+#define BEGIN_LOOP 2
+#define RETURN_FUNC 3
+#define MULTILINE_RETURN_FUNC 4
+#define EXIT_FUNC 5
+#define NUM_LOC_TYPES 6
 
 
 static llvm::cl::OptionCategory MyToolCategory(
@@ -35,49 +50,244 @@ extern llvm::cl::opt<bool> do_inline;
 
 extern llvm::cl::opt<std::string> selectfile;
 
-typedef struct inst_loc {
-    int line = -1;
-    int col = -1;
-    int kind = -1;
-    const char* return_type;
-    const char* func_name;
-    const char* full_timer_name;
+extern llvm::cl::opt<unsigned> min_statements;
+
+extern llvm::cl::opt<unsigned> min_nodes;
+
+extern llvm::cl::opt<unsigned> min_lines;
+
+extern llvm::cl::opt<bool> skip_leaf;
+
+extern llvm::cl::opt<bool> timer_ids;
+
+extern llvm::cl::opt<bool> throttle;
+
+extern llvm::cl::opt<unsigned> throttle_calls;
+
+extern llvm::cl::opt<double> throttle_usec;
+
+extern llvm::cl::opt<bool> groups;
+
+extern llvm::cl::opt<unsigned> group_small;
+
+extern llvm::cl::opt<bool> enable_table;
+
+// Everything about an instrumented function that its begin location and all
+// of its return locations have in common. Built once per function definition;
+// the strings are interned in the instrumentor's loc_arena.
+typedef struct func_info {
+    llvm::StringRef return_type;
+    llvm::StringRef func_name;
+    llvm::StringRef full_timer_name;
+    // ${timer_id}: an identifier derived from full_timer_name, and
+    // ${static_handle}: the name of the function's static timer handle
+    llvm::StringRef timer_id;
+    llvm::StringRef static_handle;
+    // ${timer_index}: the dense index of the function's timer in the table
+    // of its output file, ${timer_table}: that table's name; and with
+    // --salt_timer_ids, "<timer_table>:<timer_index>" to emit for the name
+    llvm::StringRef timer_index;
+    llvm::StringRef timer_table;
+    llvm::StringRef timer_key;
+    // Real path of the file holding the definition; keys instrumentor::locs_by_file
+    llvm::StringRef file;
+    // The same file in the translation unit being visited
+    clang::FileID fid;
+    // --salt_groups: the group whose #if wraps the function's probes
+    salt::FunctionGroup group = salt::FunctionGroup::TopLevel;
+    // For the timer of a loop (select file "loops" command): the loop or
+    // function it is nested in, and how many timed loops deep it is
+    func_info* parent = nullptr;
+    unsigned loop_depth = 0;
     bool has_args = false;
     bool is_return_ptr = false;
     bool needs_move = false;
     bool skip = false;
+} func_info;
+
+typedef struct inst_loc {
+    int line = -1;
+    int col = -1;
+    int kind = -1;
+    func_info* func = nullptr;
+    // Byte offsets into the file: the insertion point, or for a return
+    // statement its first character and one past its ';'. Equal for
+    // insertions (function begin and closing brace).
+    unsigned offset = 0;
+    unsigned end_offset = 0;
+    // Whether a return statement has a value, which then lies between the
+    // "return" keyword and the ';'
+    bool has_value = false;
+    // For a return inside timed loops: the innermost, which it stops first
+    func_info* loop = nullptr;
 } inst_loc;
 
+// Backing store for the inst_locs and func_infos of one instrumentor. Both
+// records are trivially destructible, so they are bump-allocated and released
+// together with the string pool instead of being deleted one by one.
+typedef struct loc_arena {
+    llvm::BumpPtrAllocator alloc;
+    llvm::UniqueStringSaver strings{alloc};
+} loc_arena;
+
+// A file written by instrumentor::instrument(), either rewritten with
+// instrumentation or copied through unchanged because it was skipped.
+typedef struct inst_output {
+    std::string source;
+    std::string output;
+    bool instrumented = false;
+    std::string instrumentation;
+} inst_output;
+
+// Placeholder slots of the configured C/C++ snippets, in the order
+// salt::SnippetTemplate::expand() takes their values
+enum snippet_slot
+{
+    FULL_TIMER_NAME_SLOT,
+    TIMER_ID_SLOT,
+    STATIC_HANDLE_SLOT,
+    TIMER_INDEX_SLOT,
+    TIMER_TABLE_SLOT,
+    NUM_SNIPPET_SLOTS
+};
+
+// One configured insertion, compiled line by line
+typedef std::vector<salt::SnippetTemplate> snippet;
+
+// The configuration file, parsed and compiled once per process
+typedef struct inst_config {
+    std::string instrumentation;
+    std::vector<std::string> includes;
+    snippet main_insert;
+    snippet main_insert_scope;
+    // main_insert(_scope) for a main() without arguments: TAU_INIT is dropped
+    snippet main_insert_noargs;
+    snippet main_insert_scope_noargs;
+    snippet function_begin_insert;
+    snippet function_begin_insert_scope;
+    snippet function_end_insert;
+    // Around timed loops; each one the matching function snippet if the
+    // config does not give it
+    snippet loop_begin_insert;
+    snippet loop_begin_insert_scope;
+    snippet loop_end_insert;
+    bool has_main_insert_scope = false;
+    bool has_function_begin_insert_scope = false;
+} inst_config;
+
+// Returns the compiled configfile, reading it again only if the option or the
+// file's modification time changed. Returns null if it cannot be read.
+std::shared_ptr<const inst_config> get_inst_config();
+
+// Serializes console output from translation units instrumented in parallel
+extern std::mutex output_mutex;
+
 #endif
 
 // Utility functions required in the frontend too
 bool comp_inst_loc(inst_loc *first, inst_loc *second); // only works for inst_locs that are in the same file
 bool eq_inst_loc(inst_loc *first, inst_loc *second);
-bool check_file_against_list(std::list<std::string> list, std::string fname);
-
-static std::vector<inst_loc*> inst_locs;
-static std::vector<std::string> files_to_go;
-static std::vector<std::string> files_skipped;
-static bool inst_inline = false;
+bool check_file_against_list(const salt::SelectMatcher &list, std::string fname);
 
 class instrumentor {
 public:
 
     clang::tooling::ClangTool* Tool = nullptr;
-    char* exec_name;
+    char* exec_name = nullptr;
     std::set<std::string> file_set;
 
+    // Per-translation-unit state. Every instrumentor owns the locations and
+    // file lists gathered by its own Tool, so several instrumentors can parse
+    // and rewrite different translation units concurrently (see -j).
+    std::vector<std::string> files_to_go;
+    std::vector<std::string> files_skipped;
+    bool inst_inline = false;
+
+    // Per-function records referenced by the locations, keyed by the definition
+    std::vector<func_info*> funcs;
+    llvm::DenseMap<const clang::FunctionDecl*, func_info*> func_table;
+    // Canonical declarations of the functions called directly in the
+    // translation unit, which --salt_groups puts in the INTERIOR group
+    llvm::DenseSet<const clang::FunctionDecl*> called_funcs;
+
+    // Instrumentation locations bucketed by func_info::file, filled as the
+    // visitors find them so instrument() never scans other files' locations
+    llvm::StringMap<std::vector<inst_loc*>> locs_by_file;
+    // Resolved path of every file name seen by real_path_of
+    llvm::StringMap<llvm::StringRef> real_paths;
+    // Contents of each main file as parsed, keyed like locs_by_file, so
+    // instrument() rewrites the text the locations were computed against
+    llvm::StringMap<std::string> file_buffers;
+
+    // Owns the locations, funcs and their strings until release_locs()
+    std::unique_ptr<loc_arena> arena;
+
+    // Write "<dir>/<name>.inst.<ext>" next to each source instead of
+    // "<name>.inst.<ext>" in the working directory (batch mode).
+    bool inst_beside_source = false;
+
+    // Files written by instrument(), in the order they were produced
+    std::vector<inst_output> outputs;
+
+    // Where the phases below are timed for --salt_time_report, or null
+    salt::FileTiming* timing = nullptr;
+
+    // Functions below these sizes are not instrumented (--salt_min_*), and
+    // are listed in size_report if it is not null
+    salt::SizeThresholds size_thresholds;
+    salt::SizeReport* size_report = nullptr;
+
     instrumentor();
 
+    ~instrumentor();
+
     void set_exec_name(const char* name);
 
-    void run_tool();
+    // Returns the ClangTool status: 0 on success, 1 on errors, 2 if some files were skipped
+    int run_tool();
+
+    // Allocates a location of func owned by arena and files it under func's
+    // file in locs_by_file; it is freed by release_locs()
+    inst_loc* make_inst_loc(func_info* func);
+
+    // Drops all locations and function records and frees their storage
+    void release_locs();
+
+    // Returns the resolved path of fid, interned in arena, or "" if it is not a file
+    llvm::StringRef real_path_of(clang::FileID fid, clang::SourceManager& src_mgr);
+
+    // Keeps a copy of the main file of the translation unit being parsed
+    void save_main_buffer(clang::SourceManager& src_mgr);
+
+    // Returns the record for func's definition, computing its names on first use
+    func_info* get_func_info(clang::FunctionDecl* func, clang::ASTContext* context, clang::SourceManager& src_mgr);
+
+    // Allocates the record of a loop timed inside parent (its function or
+    // enclosing timed loop), named timer_name; it is not listed in funcs
+    func_info* make_loop_info(func_info* parent, const std::string &timer_name);
+
+    // Name of the instrumented file to write for source file fname
+    std::string inst_file_name(const std::string &fname) const;
 
     // Handles a list of instrumentation locations to be included (include=true) or excluded (include=false)
-    void instr_request(std::list<std::string> list, bool include);
+    void instr_request(const salt::SelectMatcher &list, bool include);
+
+    // Writes source with the code for inst_locations (sorted by comp_inst_loc) applied;
+    // timers are the numbered functions of number_timers(). Returns false, having
+    // written nothing, if the edits cannot be applied.
+    bool instrument_file(llvm::StringRef source, std::ofstream &inst_file, std::string filename,
+                     std::vector<inst_loc *> inst_locations, const std::vector<func_info *> &timers,
+                     bool use_cxx_api, const inst_config &config);
+
+    // Gives the functions and loops timed in file (sorted locs) their ${timer_index}
+    // and ${timer_table}, and returns them in index order
+    std::vector<func_info*> number_timers(llvm::StringRef file, const std::vector<inst_loc*> &locs);
 
-    void instrument_file(std::ifstream &og_file, std::ofstream &inst_file, std::string filename,
-                     std::vector<inst_loc *> inst_locations, bool use_cxx_api, ryml::Tree yaml_tree);
+    // Writes the --salt_timer_ids name table of source's output to path
+    static bool write_timer_table(const std::string &path, const std::string &source,
+                                  const std::vector<func_info*> &timers);
 
-    void instrument();
+    // Writes the output of every file of files_to_go and files_skipped.
+    // Returns false if the config or an output could not be used or written.
+    bool instrument();
 };
@@ -0,0 +1,116 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#ifndef PROFILE_REDUCE_H
+#define PROFILE_REDUCE_H
+
+#include <list>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace salt {
+    // One routine of a previous run's profile, summed over every thread
+    struct ProfileEntry {
+        std::string name;
+        double calls{0};
+        double subrs{0};
+        double exclusiveUsec{0};
+        double inclusiveUsec{0};
+    };
+
+    /**
+     * A tau_reduce-style rule such as "calls > 1e6 && usec/call < 2": one or
+     * more comparisons joined by "&&" (or "&"), all of which must hold. The
+     * fields are calls (or numcalls), subrs (or numsubrs), usec and cumusec
+     * (exclusive and inclusive microseconds), usec/call and cumusec/call.
+     */
+    class ReduceRule {
+    public:
+        // Returns the rule, or nothing with error set if text does not parse
+        static std::optional<ReduceRule> parse(llvm::StringRef text, std::string &error);
+
+        [[nodiscard]] bool matches(const ProfileEntry &entry) const;
+
+        [[nodiscard]] const std::string &text() const { return text_; }
+
+    private:
+        enum class Field { Calls, Subrs, Usec, CumUsec, UsecPerCall, CumUsecPerCall };
+        enum class Op { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual };
+
+        struct Condition {
+            Field field;
+            Op op;
+            double value;
+        };
+
+        std::string text_;
+        std::vector<Condition> conditions_;
+    };
+
+    /**
+     * Derives an exclude list from the profile of a previous run. A routine
+     * matching any rule is excluded by its timer name, without the
+     * " [{file} {line,col}-{line,col}]" suffix SALT-FM appends, which is
+     * what the select file matchers compare against.
+     *
+     * Profiles are TAU profile.* files, directories holding them, or CSV
+     * files with one "name,calls,inclusive_usec[,exclusive_usec]" line per
+     * routine; without an exclusive time it is taken to be the inclusive one.
+     */
+    class ProfileReduction {
+    public:
+        static constexpr const char *defaultRule = "calls > 1e6 && usec/call < 2";
+
+        // Adds the rules of text, separated by ';' or newlines
+        bool addRules(llvm::StringRef text, std::string &error);
+
+        bool readProfile(llvm::StringRef path, std::string &error);
+
+        [[nodiscard]] bool hasRules() const { return !rules.empty(); }
+
+        [[nodiscard]] size_t profiledRoutines() const { return entries.size(); }
+
+        // The routine names to exclude, in profile order, without duplicates
+        [[nodiscard]] std::list<std::string> excludedRoutines() const;
+
+        // Writes the excluded routines as a select file, with their profile in comments
+        void write(llvm::raw_ostream &os) const;
+
+        // Writes the select file to path; prints an error and returns false if it cannot
+        bool write(llvm::StringRef path) const;
+
+    private:
+        bool readTauProfile(llvm::StringRef path, llvm::StringRef content, std::string &error);
+
+        bool readCSV(llvm::StringRef path, llvm::StringRef content, std::string &error);
+
+        void add(ProfileEntry entry);
+
+        // Index of the rule excluding entry, or nothing
+        [[nodiscard]] std::optional<size_t> matchingRule(const ProfileEntry &entry) const;
+
+        std::vector<ReduceRule> rules;
+        std::vector<ProfileEntry> entries;
+        llvm::StringMap<size_t> entryIndex;
+    };
+}
+
+#endif // PROFILE_REDUCE_H
@@ -0,0 +1,81 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+/* Run-time switches of the probes inserted with --salt_enable_table, from
+ * the salt-enable library. Every instrumented file holds a table with one
+ * enable bit per function, indexed by ${timer_index}, and registers it when
+ * the program starts; each probe runs only if its function's bit was set on
+ * entry. All bits start set. $SALT_ENABLE is applied to each table as it
+ * is registered, and salt_enable_set() or salt_enable_apply() change the
+ * bits of all registered tables while the program runs.
+ *
+ * A pattern matches a full timer name, e.g.
+ * "long leaf(long, long)  [{/src/kernels.c} {22,1}-{25,1}]" (two spaces
+ * before the '[', and the file as it was given to the instrumentor), as a
+ * whole; '*' stands for any run of characters and '?' for one character.
+ * A specification lists patterns separated by ';', each preceded by '-' to
+ * turn the matching functions off or optionally by '+' to turn them on,
+ * and applied in order: "-*;+*solve*" keeps only the solvers' probes.
+ *
+ * The generated code starts with a copy of this header, without its license,
+ * so it compiles without it; CMake makes the copy when it configures.
+ */
+
+#ifndef SALT_ENABLE_H
+#define SALT_ENABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reads a byte of enable bits in a probe. The bits are changed with atomic
+ * read-modify-writes, so the read is atomic too; relaxed is enough, since
+ * nothing else is published through them.
+ */
+#if defined(__GNUC__)
+#define SALT_ENABLE_LOAD(byte) __atomic_load_n(&(byte), __ATOMIC_RELAXED)
+#else
+#define SALT_ENABLE_LOAD(byte) (*(volatile unsigned char *)&(byte))
+#endif
+
+typedef struct salt_enable_table
+{
+    /* Bit i % 8 of byte i / 8 enables function i */
+    unsigned char *bits;
+    const char *const *names;
+    unsigned count;
+    /* Next registered table, set by salt_enable_register() */
+    struct salt_enable_table *next;
+} salt_enable_table;
+
+/* Adds table to the registered tables and applies $SALT_ENABLE to it */
+void salt_enable_register(salt_enable_table *table);
+
+/* Turns the probes of the registered functions whose names match pattern
+ * on (enabled != 0) or off; returns how many functions matched
+ */
+unsigned salt_enable_set(const char *pattern, int enabled);
+
+/* Applies a specification like $SALT_ENABLE to the registered functions;
+ * returns how many functions matched its patterns
+ */
+unsigned salt_enable_apply(const char *spec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SALT_ENABLE_H */
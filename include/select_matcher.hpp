@@ -0,0 +1,79 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SELECT_MATCHER_H
+#define SELECT_MATCHER_H
+
+#include <list>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace salt {
+    /**
+     * A selective instrumentation list compiled once for repeated matching.
+     *
+     * Entries without a wildcard go into hash sets. Wildcard entries are
+     * indexed by their literal prefix (the text before the first wildcard),
+     * so a lookup only runs the linear-time glob match on entries whose
+     * prefix the subject already starts with, however long the list is.
+     *
+     * Routine lists use TAU's '#' wildcard, since '*' is part of C/C++ pointer
+     * types. File lists use shell-style '*' globs; a file pattern without a
+     * '/' matches the file name in any directory.
+     */
+    class SelectMatcher {
+    public:
+        enum class Kind { Routine, File };
+
+        SelectMatcher() = default;
+
+        SelectMatcher(const std::list<std::string> &patterns, Kind kind);
+
+        [[nodiscard]] bool empty() const { return isEmpty; }
+
+        // Whole-string match of subject (after trimming whitespace) against any entry
+        [[nodiscard]] bool matches(llvm::StringRef subject) const;
+
+    private:
+        // Wildcard entries split at each wildcard, bucketed by their first piece
+        struct WildcardIndex {
+            std::unordered_map<std::string, std::vector<std::vector<std::string>>> byPrefix;
+            std::set<size_t> prefixLengths;
+
+            void insert(llvm::StringRef pattern, char wildcard);
+
+            [[nodiscard]] bool empty() const { return byPrefix.empty(); }
+
+            [[nodiscard]] bool matches(llvm::StringRef subject) const;
+        };
+
+        bool isEmpty{true};
+        // Exact routine names, or exact file patterns containing a '/'
+        std::unordered_set<std::string> exact;
+        // Exact file patterns without a '/', compared against the file name
+        std::unordered_set<std::string> exactFileNames;
+        // Routine wildcards, or file globs containing a '/'
+        WildcardIndex wildcards;
+        // File globs without a '/', tried against every path suffix after a '/'
+        WildcardIndex fileNameWildcards;
+    };
+}
+
+#endif // SELECT_MATCHER_H
@@ -3,6 +3,8 @@
 
 #include <list>
 
+#include "select_matcher.hpp"
+
 #define BEGIN_EXCLUDE_TOKEN      "BEGIN_EXCLUDE_LIST"
 #define END_EXCLUDE_TOKEN        "END_EXCLUDE_LIST"
 #define BEGIN_INCLUDE_TOKEN      "BEGIN_INCLUDE_LIST"
@@ -16,18 +18,21 @@
 
 #define INBUF_SIZE 65536
 
+// The macros below are used in a function returning bool, which returns
+// false once parseError() has reported a malformed line
+
 #define WSPACE(line) while ( line[0] == ' ' || line[0] == '\t')  \
     { \
-      if (line[0] == '\0') parseError("EOL found", line, lineno, line - original);  \
+      if (line[0] == '\0') { parseError("EOL found", line, lineno, line - original); return false; }  \
       line++;  \
     }
 
-#define TOKEN(k) if (line[0] != k || line[0] == '\0') parseError("token not found", line, lineno, (int ) (line - original)); \
+#define TOKEN(k) if (line[0] != k || line[0] == '\0') { parseError("token not found", line, lineno, (int ) (line - original)); return false; } \
 		 else line++;
 
 #define RETRIEVESTRING(pname, line) i = 0; \
        while (line[0] != '"') { \
-       if (line [0] == '\0') parseError("EOL", line, lineno, line - original); \
+       if (line [0] == '\0') { parseError("EOL", line, lineno, line - original); return false; } \
          pname[i++] = line[0]; line++; \
        } \
        pname[i] = '\0';  \
@@ -35,15 +40,21 @@
 
 #define RETRIEVENUMBER(pname, line) i = 0; \
   while (line[0] != ' ' && line[0] != '\t' ) { \
-  if (line [0] == '\0') parseError("EOL", line, lineno, line - original); \
+  if (line [0] == '\0') { parseError("EOL", line, lineno, line - original); return false; } \
     pname[i++] = line[0]; line++; \
   } \
   pname[i] = '\0';  \
   line++; /* found closing " */
 
+#define RETRIEVENUMBERATEOL(pname, line) i = 0; \
+  while (line[0] != ' ' && line[0] != '\t' && line[0] != '\0') { \
+    pname[i++] = line[0]; line++; \
+  } \
+  pname[i] = '\0';
+
 #define RETRIEVECODE(pname, line) i = 0; \
   while (line[0] != '"') { \
-    if (line [0] == '\0') parseError("EOL", line, lineno, line - original); \
+    if (line [0] == '\0') { parseError("EOL", line, lineno, line - original); return false; } \
     if (line[0] == '\\') { \
       switch(line[1]) { \
         case '\\': \
@@ -57,7 +68,7 @@
           break; \
         default: \
           parseError("Unknown escape sequence", line, lineno, line - original); \
-          break; \
+          return false; \
       } \
       line++; \
     } \
@@ -71,7 +82,37 @@ extern std::list<std::string> includelist;
 extern std::list<std::string> fileincludelist;
 extern std::list<std::string> fileexcludelist;
 
-// void parseInstrumentationCommand(char *line, int lineno);
+// The lists above compiled for matching; rebuilt by processInstrumentationRequests()
+extern salt::SelectMatcher excludematcher;
+extern salt::SelectMatcher includematcher;
+extern salt::SelectMatcher fileincludematcher;
+extern salt::SelectMatcher fileexcludematcher;
+
+// A "loops" command of the instrument section: time the loops nested at most
+// level deep in the routines matching routine (in the files matching file, if given)
+typedef struct loop_request {
+  std::string routine;
+  std::string file;
+  int level = 1;
+  salt::SelectMatcher routinematcher;
+  salt::SelectMatcher filematcher;
+} loop_request;
+
+extern std::list<loop_request> looplist;
+
+// Returns the deepest loop level requested for the routine named timer_name
+// (without its "[{file} ...]" part) defined in file fname, or 0 for none
+int loopInstrumentationLevel(llvm::StringRef timer_name, llvm::StringRef fname);
+
+// Parses one line of the instrument section; returns false if it is malformed
+bool parseInstrumentationCommand(char *line, int lineno);
+// Reads the select file fname; returns false if it cannot be read or is malformed
 bool processInstrumentationRequests(const char *fname);
 
+// Forgets every list read so far, for a process that handles several requests
+void resetInstrumentationRequests();
+
+// Appends routines to the exclude list, e.g. those derived from a profile
+void addExcludedRoutines(const std::list<std::string> &routines);
+
 #endif
@@ -0,0 +1,118 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#ifndef SIZE_FILTER_H
+#define SIZE_FILTER_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace salt {
+    /**
+     * Size of a function or procedure body: its statements, its AST (C/C++)
+     * or parse tree (Fortran) nodes, its source lines, and whether it has a
+     * loop or makes a call.
+     */
+    struct FunctionSize {
+        unsigned statements{0};
+        unsigned nodes{0};
+        unsigned lines{0};
+        bool hasLoop{false};
+        bool hasCall{false};
+    };
+
+    /**
+     * Minimum sizes of the functions worth instrumenting, in the spirit of
+     * TAU's tau_reduce but applied before anything runs. A function below any
+     * enabled threshold is not instrumented; zero disables a minimum.
+     */
+    struct SizeThresholds {
+        unsigned minStatements{0};
+        unsigned minNodes{0};
+        unsigned minLines{0};
+        // Skip functions that contain neither a loop nor a call
+        bool skipLeaf{false};
+
+        [[nodiscard]] bool enabled() const {
+            return minStatements > 0 || minNodes > 0 || minLines > 0 || skipLeaf;
+        }
+
+        [[nodiscard]] bool tooSmall(const FunctionSize &size) const;
+    };
+
+    /**
+     * The instrumentation groups of --salt_groups, named by the first that
+     * applies to a function: the main program, small functions (fewer
+     * statements than GroupClassifier::smallStatements), leaves (no calls),
+     * top-level functions (not called directly in their translation unit)
+     * and interior functions. Each probe is wrapped in "#if SALT_GROUP_<NAME>"
+     * so a group can be compiled out with -D.
+     */
+    enum class FunctionGroup {
+        Main,
+        Small,
+        Leaf,
+        TopLevel,
+        Interior
+    };
+
+    struct GroupClassifier {
+        unsigned smallStatements{4};
+
+        [[nodiscard]] FunctionGroup classify(bool isMain, const FunctionSize &size, bool called) const;
+    };
+
+    // The macro guarding the probes of group, e.g. "SALT_GROUP_LEAF"
+    [[nodiscard]] llvm::StringRef groupMacro(FunctionGroup group);
+
+    // Preprocessor lines that default every group macro to SALT_GROUP_ALL,
+    // and that to 1, written at the top of each instrumented file
+    [[nodiscard]] llvm::StringRef groupPrelude();
+
+    // A function left uninstrumented by SizeThresholds
+    struct SkippedFunction {
+        std::string name;
+        std::string file;
+        unsigned line{0};
+        FunctionSize size;
+    };
+
+    /**
+     * The functions skipped for their size in a run, safe to add to from
+     * several threads. The report is a selective instrumentation file whose
+     * exclude list names them, with their sizes in comments, so it can be
+     * reviewed and then passed back as --tau_select_file.
+     */
+    class SizeReport {
+    public:
+        void add(SkippedFunction function);
+
+        void write(llvm::raw_ostream &os, const SizeThresholds &thresholds) const;
+
+        // Writes the report to path; prints an error and returns false if it cannot
+        bool write(llvm::StringRef path, const SizeThresholds &thresholds) const;
+
+    private:
+        mutable std::mutex mutex;
+        std::vector<SkippedFunction> functions;
+    };
+}
+
+#endif // SIZE_FILTER_H
@@ -0,0 +1,62 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SNIPPET_TEMPLATE_H
+#define SNIPPET_TEMPLATE_H
+
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace salt {
+    /**
+     * One line of configured instrumentation code, split once into literal
+     * segments and "${name}" placeholder slots.
+     *
+     * The placeholder names are fixed when the template is compiled; each one
+     * becomes the index of its name in that list, and expand() takes the
+     * values in the same order. "${...}" sequences naming anything else are
+     * kept as literal text, so expansion is a single append pass.
+     */
+    class SnippetTemplate {
+    public:
+        SnippetTemplate() = default;
+
+        SnippetTemplate(llvm::StringRef text, llvm::ArrayRef<llvm::StringRef> placeholders);
+
+        // Appends the template to out with slot i replaced by values[i], or by
+        // nothing for the slots past the end of values
+        void expand(std::string &out, llvm::ArrayRef<llvm::StringRef> values) const;
+
+        // Returns the expanded template as a new string
+        [[nodiscard]] std::string str(llvm::ArrayRef<llvm::StringRef> values) const;
+
+    private:
+        // Literal text followed by a slot index, or noSlot for the last segment
+        struct Segment {
+            std::string literal;
+            size_t slot;
+        };
+
+        static constexpr size_t noSlot = static_cast<size_t>(-1);
+
+        std::vector<Segment> segments;
+        size_t literalSize{0};
+    };
+}
+
+#endif // SNIPPET_TEMPLATE_H
@@ -0,0 +1,114 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace salt {
+    /**
+     * Stages of instrumenting a file that a time report accounts for
+     * separately: reading the configuration, parsing (with semantic analysis
+     * for Fortran), walking the AST or parse tree for instrumentation points,
+     * reading and matching the select file, and writing the output.
+     */
+    enum class Phase { Config, Parse, Visit, Select, Rewrite };
+
+    constexpr size_t numPhases = 5;
+
+    [[nodiscard]] llvm::StringRef phaseName(Phase phase);
+
+    struct PhaseTime {
+        double wall{0};
+        double cpu{0};
+
+        PhaseTime &operator+=(const PhaseTime &other);
+        PhaseTime &operator-=(const PhaseTime &other);
+    };
+
+    // A wall-clock time together with the CPU time used so far by the calling thread
+    struct TimeStamp {
+        std::chrono::steady_clock::time_point wall;
+        double cpu{0};
+
+        [[nodiscard]] static TimeStamp now();
+    };
+
+    [[nodiscard]] PhaseTime operator-(const TimeStamp &end, const TimeStamp &start);
+
+    // Time spent on one file, and how many functions were found and instrumented in it
+    struct FileTiming {
+        std::string file;
+        PhaseTime phases[numPhases];
+        unsigned functionsVisited{0};
+        unsigned functionsInstrumented{0};
+
+        PhaseTime &operator[](Phase phase) {
+            return phases[static_cast<size_t>(phase)];
+        }
+
+        const PhaseTime &operator[](Phase phase) const {
+            return phases[static_cast<size_t>(phase)];
+        }
+    };
+
+    /**
+     * Adds the time from construction until stop() or destruction to one
+     * phase of a FileTiming. CPU time is that of the calling thread, so the
+     * files instrumented by parallel workers are each charged their own.
+     * Does nothing when timing is null, i.e. when no report was asked for.
+     */
+    class PhaseTimer {
+    public:
+        PhaseTimer(FileTiming *timing, Phase phase);
+
+        ~PhaseTimer() {
+            stop();
+        }
+
+        void stop();
+
+    private:
+        FileTiming *timing;
+        Phase phase;
+        TimeStamp start;
+    };
+
+    // The timings of every file of a run, safe to add to from several threads
+    class TimeReport {
+    public:
+        void add(FileTiming timing);
+
+        // Prints a table with one row per file and a total, in the style of -ftime-report
+        void print(llvm::raw_ostream &os) const;
+
+        // Writes the report as JSON to path; prints an error and returns false if it cannot
+        bool writeJSON(llvm::StringRef path) const;
+
+    private:
+        mutable std::mutex mutex;
+        std::vector<FileTiming> files;
+    };
+}
+
+#endif // TIME_REPORT_H
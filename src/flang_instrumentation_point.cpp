@@ -17,7 +17,6 @@ limitations under the License.
 #include <string>
 #include <sstream>
 #include <iomanip>
-#include <regex>
 
 #include "flang/Common/idioms.h"
 
@@ -28,6 +27,13 @@ limitations under the License.
 
 using namespace std::string_literals;
 
+llvm::ArrayRef<llvm::StringRef> salt::fortran::instrumentationPlaceholders() {
+    static const llvm::StringRef placeholders[] = {SALT_FORTRAN_TIMER_NAME_PLACEHOLDER,
+                                                   SALT_FORTRAN_TIMER_INDEX_PLACEHOLDER,
+                                                   SALT_FORTRAN_TIMER_TABLE_PLACEHOLDER};
+    return placeholders;
+}
+
 std::string salt::fortran::InstrumentationPoint::typeString() const {
     switch (instrumentationType()) {
         case InstrumentationPointType::PROGRAM_BEGIN:
@@ -67,9 +73,19 @@ std::string salt::fortran::InstrumentationPoint::toString() const {
 }
 
 std::string salt::fortran::InstrumentationPoint::instrumentationString(const InstrumentationMap &instMap,
-                                                                       [[maybe_unused]] const std::string &lineText)
+                                                                       [[maybe_unused]] std::string_view lineText)
 const {
-    return instMap.at(instrumentationType());
+    return grouped(instMap.at(instrumentationType()).str({}));
+}
+
+std::string salt::fortran::InstrumentationPoint::grouped(std::string text) const {
+    if (group_.empty()) {
+        return text;
+    }
+    if (!text.empty() && text.back() != '\n') {
+        text += "\n";
+    }
+    return "#if "s + group_ + "\n"s + text + "#endif"s;
 }
 
 std::string salt::fortran::ProgramBeginInstrumentationPoint::toString() const {
@@ -80,10 +96,8 @@ std::string salt::fortran::ProgramBeginInstrumentationPoint::toString() const {
 }
 
 std::string salt::fortran::ProgramBeginInstrumentationPoint::instrumentationString(
-    const InstrumentationMap &instMap, [[maybe_unused]] const std::string &lineText) const {
-    static std::regex timerNameRegex{SALT_FORTRAN_TIMER_NAME_TEMPLATE};
-    const std::string instTemplate{InstrumentationPoint::instrumentationString(instMap, lineText)};
-    return std::regex_replace(instTemplate, timerNameRegex, timerName());
+    const InstrumentationMap &instMap, [[maybe_unused]] std::string_view lineText) const {
+    return grouped(instMap.at(instrumentationType()).str({timerName_, timerIndex_, timerTable_}));
 }
 
 std::string salt::fortran::ProcedureBeginInstrumentationPoint::toString() const {
@@ -94,10 +108,8 @@ std::string salt::fortran::ProcedureBeginInstrumentationPoint::toString() const
 }
 
 std::string salt::fortran::ProcedureBeginInstrumentationPoint::instrumentationString(
-    const InstrumentationMap &instMap, [[maybe_unused]] const std::string &lineText) const {
-    static std::regex timerNameRegex{SALT_FORTRAN_TIMER_NAME_TEMPLATE};
-    const std::string instTemplate{InstrumentationPoint::instrumentationString(instMap, lineText)};
-    return std::regex_replace(instTemplate, timerNameRegex, timerName());
+    const InstrumentationMap &instMap, [[maybe_unused]] std::string_view lineText) const {
+    return grouped(instMap.at(instrumentationType()).str({timerName_, timerIndex_, timerTable_}));
 }
 
 std::string salt::fortran::IfReturnStmtInstrumentationPoint::toString() const {
@@ -115,7 +127,7 @@ std::string salt::fortran::IfReturnStmtInstrumentationPoint::toString() const {
 }
 
 std::string salt::fortran::IfReturnStmtInstrumentationPoint::instrumentationString(
-    const InstrumentationMap &instMap, [[maybe_unused]] const std::string &lineText) const {
+    const InstrumentationMap &instMap, [[maybe_unused]] std::string_view lineText) const {
     std::stringstream ss;
     // F2018 R601: numeric labels occupy cols 1-5 (fixed form) followed
     // by whitespace before the statement; free form accepts the same
@@ -26,9 +26,11 @@ limitations under the License.
 #include <variant>
 #include <optional>
 #include <tuple>
-#include <regex>
+#include <set>
 #include <algorithm>
 #include <filesystem>
+#include <cstdlib>
+#include <cstdio>
 
 
 #define RYML_SINGLE_HDR_DEFINE_NOW
@@ -53,6 +55,12 @@ limitations under the License.
 
 #include <clang/Basic/SourceLocation.h>
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/xxhash.h"
+
 #include "flang/Frontend/FrontendActions.h"
 #include "flang/Frontend/FrontendPluginRegistry.h"
 #include "flang/Parser/dump-parse-tree.h"
@@ -66,6 +74,9 @@ limitations under the License.
 #include "selectfile.hpp"
 #include "flang_source_location.hpp"
 #include "flang_instrumentation_point.hpp"
+#include "profile_reduce.hpp"
+#include "size_filter.hpp"
+#include "time_report.hpp"
 
 using namespace std::string_literals;
 using namespace Fortran::frontend;
@@ -75,60 +86,160 @@ using namespace Fortran::frontend;
  * Visits each node in the parse tree.
  */
 namespace salt::fortran {
+    /**
+     * Measures the executable part of a procedure for the size thresholds.
+     * Every execution-part construct counts as a statement, including those
+     * nested in a construct's block; intrinsic function references count as calls.
+     */
+    struct ProcedureSizeVisitor {
+        salt::FunctionSize size;
+
+        template<typename A>
+        bool Pre(const A &) {
+            ++size.nodes;
+            return true;
+        }
+
+        template<typename A>
+        static void Post(const A &) {
+            // this space intentionally left blank
+        }
+
+        bool Pre(const Fortran::parser::ExecutionPartConstruct &) {
+            ++size.nodes;
+            ++size.statements;
+            return true;
+        }
+
+        bool Pre(const Fortran::parser::DoConstruct &) {
+            ++size.nodes;
+            size.hasLoop = true;
+            return true;
+        }
+
+        bool Pre(const Fortran::parser::ForallConstruct &) {
+            ++size.nodes;
+            size.hasLoop = true;
+            return true;
+        }
+
+        bool Pre(const Fortran::parser::ForallStmt &) {
+            ++size.nodes;
+            size.hasLoop = true;
+            return true;
+        }
+
+        bool Pre(const Fortran::parser::CallStmt &) {
+            ++size.nodes;
+            size.hasCall = true;
+            return true;
+        }
+
+        bool Pre(const Fortran::parser::FunctionReference &) {
+            ++size.nodes;
+            size.hasCall = true;
+            return true;
+        }
+    };
+
+    /**
+     * Collects the names of the procedures an input calls or references as
+     * functions, for the INTERIOR group of $SALT_FORTRAN_GROUPS. Type-bound
+     * procedure calls are not resolved.
+     */
+    struct CalledNameVisitor {
+        std::set<std::string> names;
+
+        template<typename A>
+        static bool Pre(const A &) {
+            return true;
+        }
+
+        template<typename A>
+        static void Post(const A &) {
+            // this space intentionally left blank
+        }
+
+        bool Pre(const Fortran::parser::ProcedureDesignator &designator) {
+            if (const auto *name = std::get_if<Fortran::parser::Name>(&designator.u)) {
+                names.insert(name->ToString());
+            }
+            return true;
+        }
+    };
+
     class SaltInstrumentAction final : public PluginParseTreeAction {
         struct SaltInstrumentParseTreeVisitor {
             explicit SaltInstrumentParseTreeVisitor(Fortran::parser::Parsing *parsing,
-                                                    const bool skipInstrument = false)
-                : mainProgramLine_(0), subProgramLine_(0), skipInstrumentFile_(skipInstrument), parsing(parsing) {
+                                                    const bool skipInstrument = false,
+                                                    std::string timerTable = ""s)
+                : mainProgramLine_(0), subProgramLine_(0), skipInstrumentFile_(skipInstrument),
+                  timerTable_(std::move(timerTable)), parsing(parsing) {
             }
 
             bool shouldInstrument() const {
                 return !skipInstrumentFile_ && !skipInstrumentSubprogram_;
             }
 
-            void addProgramBeginInstrumentation(const int start_line, const std::string &timer_name) {
-                if (shouldInstrument()) {
-                    instrumentationPoints_.emplace_back(
-                        std::make_unique<ProgramBeginInstrumentationPoint>(start_line, timer_name));
-                }
+            void addProgramBeginInstrumentation(const int start_line, const std::string &timer_name,
+                                                const std::string &timer_index) {
+                addInstrumentationPoint(std::make_unique<ProgramBeginInstrumentationPoint>(
+                    start_line, timer_name, timer_index, timerTable_));
             }
 
-            void addProcedureBeginInstrumentation(const int start_line, const std::string &timer_name) {
-                if (shouldInstrument()) {
-                    instrumentationPoints_.emplace_back(
-                        std::make_unique<ProcedureBeginInstrumentationPoint>(start_line, timer_name));
-                }
+            void addProcedureBeginInstrumentation(const int start_line, const std::string &timer_name,
+                                                  const std::string &timer_index) {
+                addInstrumentationPoint(std::make_unique<ProcedureBeginInstrumentationPoint>(
+                    start_line, timer_name, timer_index, timerTable_));
             }
 
             void addProcedureEndInstrumentation(const int end_line) {
-                if (shouldInstrument()) {
-                    instrumentationPoints_.emplace_back(std::make_unique<ProcedureEndInstrumentationPoint>(end_line));
-                }
+                addInstrumentationPoint(std::make_unique<ProcedureEndInstrumentationPoint>(end_line));
             }
 
             void addReturnStmtInstrumentation(const int end_line) {
-                if (shouldInstrument()) {
-                    instrumentationPoints_.emplace_back(std::make_unique<ReturnStmtInstrumentationPoint>(end_line));
-                }
+                addInstrumentationPoint(std::make_unique<ReturnStmtInstrumentationPoint>(end_line));
             }
 
             void addIfReturnStmtInstrumentation(const int start_line, const int end_line,
                                                 std::string condition_text,
                                                 std::string return_expr_text,
                                                 std::optional<long> label) {
-                if (shouldInstrument()) {
-                    instrumentationPoints_.emplace_back(
-                        std::make_unique<IfReturnStmtInstrumentationPoint>(start_line, end_line,
-                                                                           std::move(condition_text),
-                                                                           std::move(return_expr_text),
-                                                                           std::move(label)));
-                }
+                addInstrumentationPoint(std::make_unique<IfReturnStmtInstrumentationPoint>(
+                    start_line, end_line, std::move(condition_text), std::move(return_expr_text), std::move(label)));
+            }
+
+            // The procedures called by name anywhere in the input, which
+            // $SALT_FORTRAN_GROUPS puts in the INTERIOR group
+            void setCalledNames(std::set<std::string> names) {
+                calledNames_ = std::move(names);
             }
 
             [[nodiscard]] const auto &getInstrumentationPoints() const {
                 return instrumentationPoints_;
             }
 
+            // The full timer names of the instrumented procedures, in ${timer_index} order
+            [[nodiscard]] const std::vector<std::string> &getTimerNames() const {
+                return timerNames_;
+            }
+
+            [[nodiscard]] const std::string &getTimerTable() const {
+                return timerTable_;
+            }
+
+            [[nodiscard]] unsigned proceduresVisited() const {
+                return proceduresVisited_;
+            }
+
+            [[nodiscard]] unsigned proceduresInstrumented() const {
+                return static_cast<unsigned>(std::count_if(
+                    instrumentationPoints_.cbegin(), instrumentationPoints_.cend(), [](const auto &instPt) {
+                        return instPt->instrumentationType() == InstrumentationPointType::PROGRAM_BEGIN ||
+                               instPt->instrumentationType() == InstrumentationPointType::PROCEDURE_BEGIN;
+                    }));
+            }
+
             [[nodiscard]] std::string dumpInstrumentationPoints() const {
                 std::stringstream ss;
                 for (const auto &instPt: getInstrumentationPoints()) {
@@ -137,18 +248,6 @@ namespace salt::fortran {
                 return ss.str();
             }
 
-            [[nodiscard]] static std::string convertWildcardToRegexForm(const std::string &wildString) {
-                // Escape all regex special characters
-                static const std::regex metacharacters(R"([\.\^\$\+\(\)\[\]\{\}\|\?\*])");
-                const std::string escapedString{std::regex_replace(wildString, metacharacters, R"(\$&)")};
-                // Convert lines in TAU select file format (where "#" means zero or more characters)
-                // to regex version (where ".*" means zero or more characters).
-                // "#" is used for wildcard in routine names in TAU selective instrumentation files
-                // because "*" can be used in C/C++ function identifiers as part of pointer types.
-                static const std::regex hashRegex{R"(#)"};
-                return std::regex_replace(escapedString, hashRegex, ".*");
-            }
-
             [[nodiscard]] static bool shouldInstrumentSubprogram(const std::string &subprogramName) {
                 // Check if this subprogram should be instrumented.
                 // It should if:
@@ -156,31 +255,18 @@ namespace salt::fortran {
                 //   - An exclude list is present and the subprogram is not in it
                 //   - An include list is present and the subprogram is in it (and not on the exclude list)
 
-                if (includelist.empty() && excludelist.empty()) {
+                if (includematcher.empty() && excludematcher.empty()) {
                     return true;
                 }
 
-                for (const auto &excludeEntry: excludelist) {
-                    if (const std::regex excludeRegex{convertWildcardToRegexForm(excludeEntry)}; std::regex_match(
-                        subprogramName, excludeRegex)) {
-                        return false;
-                    }
-                }
-
-                bool subprogramInIncludeList{false};
-                for (const auto &includeEntry: includelist) {
-                    if (const std::regex includeRegex{convertWildcardToRegexForm(includeEntry)}; std::regex_match(
-                        subprogramName, includeRegex)) {
-                        subprogramInIncludeList = true;
-                        break;
-                    }
+                // "#" is the wildcard in routine names in TAU selective instrumentation files
+                // because "*" can be used in C/C++ function identifiers as part of pointer types.
+                if (excludematcher.matches(subprogramName)) {
+                    return false;
                 }
 
-                if (!includelist.empty()) {
-                    if (subprogramInIncludeList) {
-                        return true;
-                    }
-                    return false;
+                if (!includematcher.empty()) {
+                    return includematcher.matches(subprogramName);
                 }
 
                 return true;
@@ -278,6 +364,16 @@ namespace salt::fortran {
                 return 1;
             }
 
+            // Open a Chrome trace section for the walk of a procedure, closed
+            // by its Post(); named after the procedure's start statement.
+            template <typename SubprogramT, typename StartStmtT>
+            static void traceProcedureBegin(const SubprogramT &subprogram) {
+                if (llvm::timeTraceProfilerEnabled()) {
+                    const auto &startStmt = std::get<Fortran::parser::Statement<StartStmtT> >(subprogram.t);
+                    llvm::timeTraceProfilerBegin("VisitProcedure", startStmt.source.ToString());
+                }
+            }
+
             // MainProgram special-case: ProgramStmt is optional (Fortran
             // permits an implicit main program with no `program` keyword).
             // Falls back to column 1 for the implicit form.
@@ -295,6 +391,15 @@ namespace salt::fortran {
             }
 
             bool Pre(const Fortran::parser::MainProgram &mainProgram) {
+                ++proceduresVisited_;
+                if (llvm::timeTraceProfilerEnabled()) {
+                    const auto &maybeProgStmt =
+                        std::get<std::optional<Fortran::parser::Statement<Fortran::parser::ProgramStmt> > >(
+                            mainProgram.t);
+                    llvm::timeTraceProfilerBegin("VisitProcedure", maybeProgStmt.has_value()
+                                                                       ? maybeProgStmt->source.ToString()
+                                                                       : "program"s);
+                }
                 isInMainProgram_ = true;
                 captureBodyEndLines<Fortran::parser::MainProgram, Fortran::parser::EndProgramStmt>(
                     mainProgram, mainProgramEndLine_, mainProgramEndCol_, mainProgramContainsLine_);
@@ -303,6 +408,9 @@ namespace salt::fortran {
             }
 
             bool Pre(const Fortran::parser::SubroutineSubprogram &subprogram) {
+                ++proceduresVisited_;
+                traceProcedureBegin<Fortran::parser::SubroutineSubprogram, Fortran::parser::SubroutineStmt>(
+                    subprogram);
                 captureBodyEndLines<Fortran::parser::SubroutineSubprogram, Fortran::parser::EndSubroutineStmt>(
                     subprogram, subProgramEndLine_, subProgramEndCol_, subProgramContainsLine_);
                 subProgramStartCol_ =
@@ -312,6 +420,8 @@ namespace salt::fortran {
             }
 
             bool Pre(const Fortran::parser::FunctionSubprogram &subprogram) {
+                ++proceduresVisited_;
+                traceProcedureBegin<Fortran::parser::FunctionSubprogram, Fortran::parser::FunctionStmt>(subprogram);
                 captureBodyEndLines<Fortran::parser::FunctionSubprogram, Fortran::parser::EndFunctionStmt>(
                     subprogram, subProgramEndLine_, subProgramEndCol_, subProgramContainsLine_);
                 subProgramStartCol_ =
@@ -326,6 +436,9 @@ namespace salt::fortran {
             // ExecutionPart, optional InternalSubprogramPart, EndMpSubprogramStmt
             // tail), and reuses the same body-end bookkeeping.
             bool Pre(const Fortran::parser::SeparateModuleSubprogram &subprogram) {
+                ++proceduresVisited_;
+                traceProcedureBegin<Fortran::parser::SeparateModuleSubprogram, Fortran::parser::MpSubprogramStmt>(
+                    subprogram);
                 captureBodyEndLines<
                     Fortran::parser::SeparateModuleSubprogram,
                     Fortran::parser::EndMpSubprogramStmt>(
@@ -338,6 +451,7 @@ namespace salt::fortran {
 
             void Post(const Fortran::parser::MainProgram &) {
                 verboseStream() << "Exit main program: " << mainProgramName_ << "\n";
+                llvm::timeTraceProfilerEnd();
                 isInMainProgram_ = false;
                 mainProgramEndLine_ = 0;
                 mainProgramEndCol_ = 1;
@@ -426,6 +540,7 @@ namespace salt::fortran {
 
             void Post(const Fortran::parser::SubroutineSubprogram &) {
                 verboseStream() << "Exit Subroutine: " << subprogramName_ << "\n";
+                llvm::timeTraceProfilerEnd();
                 skipInstrumentSubprogram_ = false;
                 subprogramName_.clear();
                 subProgramEndLine_ = 0;
@@ -453,6 +568,7 @@ namespace salt::fortran {
 
             void Post(const Fortran::parser::FunctionSubprogram &) {
                 verboseStream() << "Exit Function: " << subprogramName_ << "\n";
+                llvm::timeTraceProfilerEnd();
                 skipInstrumentSubprogram_ = false;
                 subprogramName_.clear();
                 subProgramLine_ = 0;
@@ -486,6 +602,7 @@ namespace salt::fortran {
 
             void Post(const Fortran::parser::SeparateModuleSubprogram &) {
                 verboseStream() << "Exit Module Procedure: " << subprogramName_ << "\n";
+                llvm::timeTraceProfilerEnd();
                 skipInstrumentSubprogram_ = false;
                 subprogramName_.clear();
                 subProgramLine_ = 0;
@@ -583,25 +700,52 @@ namespace salt::fortran {
 
                     const std::string timerName{ss.str()};
 
-                    // Split the timerName string so that it will fit between Fortran 77's 72-character limit,
-                    // and use character string line continuation syntax compatible with Fortran 77 and modern
-                    // Fortran.
-                    std::stringstream ss2;
-                    for (size_t i = 0; i < timerName.size(); i += SALT_F77_LINE_LENGTH) {
-                        ss2 << SALT_FORTRAN_STRING_SPLITTER;
-                        ss2 << timerName.substr(i, SALT_F77_LINE_LENGTH);
+                    // The main program carries the initialization, and a select
+                    // file include wins over size
+                    const bool checkSize = !isInMainProgram_ && shouldInstrument() &&
+                                           getProcessSizeThresholds().enabled() &&
+                                           !includematcher.matches(subprogramName_);
+                    const std::optional<salt::GroupClassifier> &groups{getProcessGroups()};
+                    ProcedureSizeVisitor sizeVisitor;
+                    if (checkSize || (groups.has_value() && shouldInstrument())) {
+                        Walk(executionPart, sizeVisitor);
+                        sizeVisitor.size.lines = static_cast<unsigned>(endLine - startLoc.line + 1);
+                    }
+                    group_.clear();
+                    if (groups.has_value()) {
+                        group_ = salt::groupMacro(groups->classify(isInMainProgram_, sizeVisitor.size,
+                                                                   calledNames_.count(subprogramName_) > 0)).str();
+                    }
+                    if (checkSize && getProcessSizeThresholds().tooSmall(sizeVisitor.size)) {
+                        verboseStream() << "Skipping instrumentation of " << subprogramName_ << ": "
+                                << sizeVisitor.size.statements << " statements, " << sizeVisitor.size.nodes
+                                << " nodes, " << sizeVisitor.size.lines << " lines\n";
+                        skipInstrumentSubprogram_ = true;
+                        if (salt::SizeReport *sizeReport = getProcessSizeReport()) {
+                            sizeReport->add({subprogramName_, startLoc.sourceFile->path(),
+                                             static_cast<unsigned>(procStartLine), sizeVisitor.size});
+                        }
                     }
 
-                    const std::string splitTimerName{ss2.str()};
+                    // Number the procedure for ${timer_index}; in timer ID mode the
+                    // probes get "<table>:<index>" and the name goes to the table
+                    const std::string timerIndex{std::to_string(timerNames_.size())};
+                    std::string splitTimerName;
+                    if (shouldInstrument()) {
+                        timerNames_.push_back(timerName);
+                        splitTimerName = splitF77String(getProcessTimerIds()
+                                                            ? timerTable_ + ":"s + timerIndex
+                                                            : timerName);
+                    }
 
                     if (isInMainProgram_) {
                         verboseStream() << "Program begin \"" << mainProgramName_ << "\" at " << startLoc.line <<
                                 ", " << startLoc.column << "\n";
-                        addProgramBeginInstrumentation(startLoc.line, splitTimerName);
+                        addProgramBeginInstrumentation(startLoc.line, splitTimerName, timerIndex);
                     } else {
                         verboseStream() << "Subprogram begin \"" << subprogramName_ << "\" at " << startLoc.line <<
                                 ", " << startLoc.column << "\n";
-                        addProcedureBeginInstrumentation(startLoc.line, splitTimerName);
+                        addProcedureBeginInstrumentation(startLoc.line, splitTimerName, timerIndex);
                     }
                 } else {
                     verboseStream() << "End at line " << endLine << "\n";
@@ -752,8 +896,27 @@ namespace salt::fortran {
             bool skipInstrumentFile_;
             bool skipInstrumentSubprogram_{false};
 
+            // ${timer_table} of this input, and the timer names by ${timer_index}
+            std::string timerTable_;
+            std::vector<std::string> timerNames_;
+
+            // Main programs and subprograms walked, instrumented or not
+            unsigned proceduresVisited_{0};
+
+            // $SALT_FORTRAN_GROUPS: the procedures called by name, and the
+            // group macro of the procedure being visited
+            std::set<std::string> calledNames_;
+            std::string group_;
+
             std::vector<std::unique_ptr<const InstrumentationPoint> > instrumentationPoints_;
 
+            void addInstrumentationPoint(std::unique_ptr<InstrumentationPoint> point) {
+                if (shouldInstrument()) {
+                    point->setGroup(group_);
+                    instrumentationPoints_.emplace_back(std::move(point));
+                }
+            }
+
             // Pass in the parser object from the Action to the Visitor
             // so that we can use it while processing parse tree nodes.
             Fortran::parser::Parsing *parsing{nullptr};
@@ -766,29 +929,77 @@ namespace salt::fortran {
          * flang/lib/Semantics/runtime-type-info.cpp for example
          * of getting the source file name.
          */
-        [[nodiscard]] static std::optional<std::string> getInputFilePath(Fortran::parser::Parsing &parsing) {
+        [[nodiscard]] static const Fortran::parser::SourceFile *getInputSourceFile(
+            Fortran::parser::Parsing &parsing) {
             const auto &allSources{parsing.allCooked().allSources()};
             if (const auto firstProv{allSources.GetFirstFileProvenance()}) {
-                if (const auto *srcFile{allSources.GetSourceFile(firstProv->start())}) {
-                    return srcFile->path();
-                }
+                return allSources.GetSourceFile(firstProv->start());
             }
-            return std::nullopt;
+            return nullptr;
         }
 
         static std::string lineDirective(const int line, const std::string &file) {
             return "#line " + std::to_string(line) + " \"" + file + "\"";
         }
 
-        static void instrumentFile(const std::string &inputFilePath, llvm::raw_pwrite_stream &outputStream,
+        /**
+         * Split a string so that it will fit between Fortran 77's 72-character limit,
+         * and use character string line continuation syntax compatible with Fortran 77
+         * and modern Fortran.
+         */
+        static std::string splitF77String(const std::string &str) {
+            std::stringstream ss;
+            for (size_t i = 0; i < str.size(); i += SALT_F77_LINE_LENGTH) {
+                ss << SALT_FORTRAN_STRING_SPLITTER;
+                ss << str.substr(i, SALT_F77_LINE_LENGTH);
+            }
+            return ss.str();
+        }
+
+        /**
+         * Write the timer table of an input, one "<timer_table>:<timer_index>"
+         * key and full timer name per line, in the format cparse-llvm writes.
+         */
+        static bool writeTimerTable(const std::string &path, const std::string &source,
+                                    const SaltInstrumentParseTreeVisitor &visitor) {
+            std::ofstream table{path};
+            if (!table) {
+                return false;
+            }
+            table << "# SALT-FM timer table of " << source << ": <timer_table>:<timer_index>\t<full_timer_name>\n";
+            const auto &names = visitor.getTimerNames();
+            for (size_t i = 0; i < names.size(); ++i) {
+                table << visitor.getTimerTable() << ":" << i << "\t" << names[i] << "\n";
+            }
+            return static_cast<bool>(table);
+        }
+
+        /**
+         * Write the instrumented source. The text is the buffer flang read the
+         * input into, so the file is not read again; lines are written out as
+         * slices of that buffer.
+         */
+        static void instrumentFile(const Fortran::parser::SourceFile &inputFile, const std::string &inputFilePath,
+                                   llvm::raw_pwrite_stream &outputStream,
                                    const SaltInstrumentParseTreeVisitor &visitor,
                                    const InstrumentationMap &instMap) {
-            std::ifstream inputStream{inputFilePath};
-            if (!inputStream) {
-                llvm::errs() << "ERROR: Could not open input file" << inputFilePath << "\n";
-                std::exit(-2);
-            }
-            std::string lineText;
+            const auto content{inputFile.content()};
+            const llvm::StringRef source{content.data(), content.size()};
+            size_t nextLineStart{0};
+            // Like std::getline: the next line without its newline, false at the end of the source
+            const auto getLine = [&](llvm::StringRef &line) {
+                if (nextLineStart >= source.size()) {
+                    return false;
+                }
+                size_t lineEnd{source.find('\n', nextLineStart)};
+                if (lineEnd == llvm::StringRef::npos) {
+                    lineEnd = source.size();
+                }
+                line = source.slice(nextLineStart, lineEnd);
+                nextLineStart = lineEnd + 1;
+                return true;
+            };
+            llvm::StringRef lineText;
             int lineNum{0};
             const auto &instPts{visitor.getInstrumentationPoints()};
 
@@ -801,10 +1012,13 @@ namespace salt::fortran {
                 DIE("ERROR: Instrumentation points not sorted by line number!\n");
             }
 
+            if (getProcessGroups().has_value()) {
+                outputStream << salt::groupPrelude();
+            }
             outputStream << lineDirective(1, inputFilePath) << "\n";
 
             auto instIter{instPts.cbegin()};
-            while (std::getline(inputStream, lineText)) {
+            while (getLine(lineText)) {
                 bool lineWasInstrumentedBefore{false};
                 bool lineWasInstrumentedAfter{false};
                 bool shouldOutputLine{true};
@@ -838,8 +1052,8 @@ namespace salt::fortran {
                         replacedThroughLine = ifReturnPt->endLine();
                     }
                     while (lineNum < replacedThroughLine) {
-                        std::string discardedLine;
-                        if (!std::getline(inputStream, discardedLine)) {
+                        llvm::StringRef discardedLine;
+                        if (!getLine(discardedLine)) {
                             break;
                         }
                         ++lineNum;
@@ -885,6 +1099,54 @@ namespace salt::fortran {
             return SALT_FORTRAN_CONFIG_DEFAULT_PATH;
         }
 
+        // The guard of $SALT_FORTRAN_THROTTLE and its thresholds
+        struct Throttle {
+            bool enabled{false};
+            unsigned long long calls{SALT_FORTRAN_THROTTLE_DEFAULT_CALLS};
+            double usec{SALT_FORTRAN_THROTTLE_DEFAULT_USEC};
+        };
+
+        [[nodiscard]] static const Throttle &getProcessThrottle() {
+            static const Throttle throttle = [] {
+                Throttle read;
+                const char *enabled = getenv(SALT_FORTRAN_THROTTLE_VAR);
+                read.enabled = enabled != nullptr && enabled != ""s && enabled != "0"s;
+                if (const char *val = getenv(SALT_FORTRAN_THROTTLE_CALLS_VAR); val != nullptr && *val != '\0') {
+                    read.calls = std::strtoull(val, nullptr, 10);
+                }
+                if (const char *val = getenv(SALT_FORTRAN_THROTTLE_USEC_VAR); val != nullptr && *val != '\0') {
+                    read.usec = std::strtod(val, nullptr);
+                }
+                return read;
+            }();
+            return throttle;
+        }
+
+        // The classifier of $SALT_FORTRAN_GROUPS and $SALT_FORTRAN_GROUP_SMALL, if groups are on
+        [[nodiscard]] static const std::optional<salt::GroupClassifier> &getProcessGroups() {
+            static const std::optional<salt::GroupClassifier> groups = []() -> std::optional<salt::GroupClassifier> {
+                const char *enabled = getenv(SALT_FORTRAN_GROUPS_VAR);
+                if (enabled == nullptr || enabled == ""s || enabled == "0"s) {
+                    return std::nullopt;
+                }
+                salt::GroupClassifier read;
+                if (const char *val = getenv(SALT_FORTRAN_GROUP_SMALL_VAR); val != nullptr && *val != '\0') {
+                    read.smallStatements = static_cast<unsigned>(std::strtoul(val, nullptr, 10));
+                }
+                return read;
+            }();
+            return groups;
+        }
+
+        // Whether $SALT_FORTRAN_TIMER_IDS asked for table keys in place of timer names
+        [[nodiscard]] static bool getProcessTimerIds() {
+            static const bool timerIds = [] {
+                const char *val = getenv(SALT_FORTRAN_TIMER_IDS_VAR);
+                return val != nullptr && val != ""s && val != "0"s;
+            }();
+            return timerIds;
+        }
+
         [[nodiscard]] static std::optional<std::string> getSelectFilePath() {
             if (const char *val = getenv(SALT_FORTRAN_SELECT_FILE_VAR)) {
                 if (std::string selectFile{val}; !selectFile.empty()) {
@@ -894,6 +1156,50 @@ namespace salt::fortran {
             return std::nullopt;
         }
 
+        /**
+         * Adds the procedures of the $SALT_FORTRAN_PROFILE profiles matching
+         * $SALT_FORTRAN_REDUCE_RULES to the exclude list, after the select
+         * file, and writes them to $SALT_FORTRAN_REDUCE_OUTPUT if it is set.
+         * Like the select file, this is done for the first input only.
+         */
+        static void applyProcessProfileReduction() {
+            static bool applied{false};
+            const char *profiles = getenv(SALT_FORTRAN_PROFILE_VAR);
+            if (applied || profiles == nullptr || *profiles == '\0') {
+                return;
+            }
+            applied = true;
+
+            salt::ProfileReduction reduction;
+            std::string error;
+            const char *rules = getenv(SALT_FORTRAN_REDUCE_RULES_VAR);
+            if (!reduction.addRules(rules != nullptr ? rules : "", error)) {
+                llvm::errs() << "ERROR: " << SALT_FORTRAN_REDUCE_RULES_VAR << ": " << error << "\n";
+                std::exit(-4);
+            }
+            if (!reduction.hasRules()) {
+                reduction.addRules(salt::ProfileReduction::defaultRule, error);
+            }
+            llvm::SmallVector<llvm::StringRef, 4> paths;
+            llvm::StringRef{profiles}.split(paths, ';', -1, false);
+            for (const llvm::StringRef path: paths) {
+                if (!reduction.readProfile(path, error)) {
+                    llvm::errs() << "ERROR: " << SALT_FORTRAN_PROFILE_VAR << ": " << error << "\n";
+                    std::exit(-4);
+                }
+            }
+
+            const std::list<std::string> excluded = reduction.excludedRoutines();
+            llvm::outs() << "SALT profile reduction: " << excluded.size() << " of " << reduction.profiledRoutines()
+                    << " profiled routines excluded\n";
+            addExcludedRoutines(excluded);
+            if (const char *output = getenv(SALT_FORTRAN_REDUCE_OUTPUT_VAR); output != nullptr && *output != '\0') {
+                if (!reduction.write(llvm::StringRef{output})) {
+                    std::exit(-4);
+                }
+            }
+        }
+
         [[nodiscard]] static ryml::Tree getConfigYamlTree(const std::string &configPath) {
             std::ifstream inputStream{configPath};
             if (!inputStream) {
@@ -925,10 +1231,15 @@ namespace salt::fortran {
                 llvm::errs() << "ERROR: '" << SALT_FORTRAN_PROGRAM_BEGIN_KEY << "' key not found under 'Fortran'.\n";
                 std::exit(-3);
             }
-            for (const ryml::ConstNodeRef child: programBeginNode.children()) {
-                ss << child.val() << "\n";
+            if (getProcessThrottle().enabled) {
+                ss << throttleBegin(programBeginNode);
+            } else {
+                for (const ryml::ConstNodeRef child: programBeginNode.children()) {
+                    ss << child.val() << "\n";
+                }
             }
-            map.emplace(InstrumentationPointType::PROGRAM_BEGIN, ss.str());
+            map.emplace(InstrumentationPointType::PROGRAM_BEGIN,
+                        salt::SnippetTemplate{ss.str(), instrumentationPlaceholders()});
             ss.str(""s);
 
             // Access and process the "procedure_begin_insert" node
@@ -937,10 +1248,15 @@ namespace salt::fortran {
                 llvm::errs() << "ERROR: '" << SALT_FORTRAN_PROCEDURE_BEGIN_KEY << "' key not found under 'Fortran'.\n";
                 std::exit(-3);
             }
-            for (const ryml::ConstNodeRef child: procedureBeginNode.children()) {
-                ss << child.val() << "\n";
+            if (getProcessThrottle().enabled) {
+                ss << throttleBegin(procedureBeginNode);
+            } else {
+                for (const ryml::ConstNodeRef child: procedureBeginNode.children()) {
+                    ss << child.val() << "\n";
+                }
             }
-            map.emplace(InstrumentationPointType::PROCEDURE_BEGIN, ss.str());
+            map.emplace(InstrumentationPointType::PROCEDURE_BEGIN,
+                        salt::SnippetTemplate{ss.str(), instrumentationPlaceholders()});
             ss.str(""s);
 
             // Access and process the "procedure_end_insert" node
@@ -952,30 +1268,83 @@ namespace salt::fortran {
             for (const ryml::ConstNodeRef child: procedureEndNode.children()) {
                 ss << child.val() << "\n";
             }
-            map.emplace(InstrumentationPointType::PROCEDURE_END, ss.str());
+            // Stopping a timer takes no placeholders, so its text is kept as written
+            const salt::SnippetTemplate procedureEnd{
+                getProcessThrottle().enabled ? throttleEnd(ss.str()) : ss.str(), {}
+            };
+            map.emplace(InstrumentationPointType::PROCEDURE_END, procedureEnd);
             // The return statement uses the same text as procedure end,
             // but is inserted before the line instead of after.
-            map.emplace(InstrumentationPointType::RETURN_STMT, ss.str());
+            map.emplace(InstrumentationPointType::RETURN_STMT, procedureEnd);
             // The if-return statement uses the same text as procedure end,
             // but requires transformation to if-then-endif
-            map.emplace(InstrumentationPointType::IF_RETURN, ss.str());
+            map.emplace(InstrumentationPointType::IF_RETURN, procedureEnd);
 
             return map;
         }
 
-        [[nodiscard]] static std::string convertGlobToRegexForm(const std::string &globString) {
-            // Convert lines in shell glob format (where "*" means zero or more characters)
-            // to regex version (where ".*" means zero or more characters).
-            // This is used for files in TAU selective instrumentation files.
-            // Order matters: escape regex metacharacters first so any "."
-            // characters in the input become "\\.", then substitute the
-            // surviving literal "*" with ".*". Doing the "*" -> ".*" rewrite
-            // first would let the inserted "." get escaped to "\\.", turning
-            // the wildcard into a quantifier on a literal dot.
-            static const std::regex metacharacters(R"([\.\^\$\+\(\)\[\]\{\}\|\?])");
-            const std::string escapedString{std::regex_replace(globString, metacharacters, R"(\$&)")};
-            static const std::regex starRegex{R"(\*)"};
-            return std::regex_replace(escapedString, starRegex, ".*");
+        /**
+         * The $SALT_FORTRAN_THROTTLE guard around the lines of a begin snippet.
+         * The guard state is saved in the procedure, and the snippet lines
+         * that declare something (those with "::") stay ahead of the guard,
+         * since Fortran declarations precede executable statements. Every line
+         * fits in fixed form without a continuation.
+         */
+        [[nodiscard]] static std::string throttleBegin(const ryml::ConstNodeRef &node) {
+            const Throttle &throttle = getProcessThrottle();
+            std::stringstream declarations;
+            std::stringstream statements;
+            for (const ryml::ConstNodeRef child: node.children()) {
+                const llvm::StringRef line{child.val().str, child.val().len};
+                (line.contains("::") ? declarations : statements) << line.str() << "\n";
+            }
+            std::stringstream ss;
+            ss << "      integer(8), save :: salt_thr_calls = 0, salt_thr_ticks = 0\n";
+            ss << "      logical, save :: salt_thr_off = .false.\n";
+            ss << "      logical :: salt_thr_on\n";
+            ss << "      integer(8) :: salt_thr_start, salt_thr_stop, salt_thr_rate\n";
+            ss << "      real(8) :: salt_thr_lim\n";
+            ss << "      integer(8), parameter :: salt_thr_min = " << throttle.calls << "_8\n";
+            ss << "      real(8), parameter :: salt_thr_usec = " << fortranDouble(throttle.usec) << "\n";
+            ss << declarations.str();
+            ss << "      salt_thr_on = .not. salt_thr_off\n";
+            ss << "      if (salt_thr_on) then\n";
+            ss << statements.str();
+            ss << "      call system_clock(salt_thr_start, salt_thr_rate)\n";
+            ss << "      end if\n";
+            return ss.str();
+        }
+
+        /**
+         * The $SALT_FORTRAN_THROTTLE guard around an end snippet: only a call
+         * whose begin snippet ran stops its timer, and is counted
+         */
+        [[nodiscard]] static std::string throttleEnd(const std::string &text) {
+            std::stringstream ss;
+            ss << "      if (salt_thr_on) then\n";
+            ss << "      call system_clock(salt_thr_stop)\n";
+            ss << "      salt_thr_calls = salt_thr_calls + 1\n";
+            ss << "      salt_thr_ticks = salt_thr_ticks + (salt_thr_stop - salt_thr_start)\n";
+            ss << text;
+            ss << "      if (salt_thr_calls .ge. salt_thr_min) then\n";
+            ss << "      salt_thr_lim = salt_thr_usec * salt_thr_rate * salt_thr_calls\n";
+            ss << "      salt_thr_off = 1d6 * salt_thr_ticks .lt. salt_thr_lim\n";
+            ss << "      end if\n";
+            ss << "      end if\n";
+            return ss.str();
+        }
+
+        // A double precision literal of value, e.g. 10d0 or 2.5d-1
+        [[nodiscard]] static std::string fortranDouble(const double value) {
+            char buffer[32];
+            std::snprintf(buffer, sizeof buffer, "%.9g", value);
+            std::string literal{buffer};
+            if (const size_t exponent = literal.find('e'); exponent != std::string::npos) {
+                literal[exponent] = 'd';
+            } else {
+                literal += "d0";
+            }
+            return literal;
         }
 
         [[nodiscard]] static bool shouldInstrumentFile(const std::filesystem::path &filePath) {
@@ -985,35 +1354,163 @@ namespace salt::fortran {
             //   - An exclude list is present and the file is not in it
             //   - An include list is present and the file is in it
 
-            if (fileincludelist.empty() && fileexcludelist.empty()) {
+            if (fileincludematcher.empty() && fileexcludematcher.empty()) {
                 return true;
             }
 
-            const auto filePart{filePath.filename()};
-            for (const auto &excludeEntry: fileexcludelist) {
-                if (const std::regex excludeRegex{convertGlobToRegexForm(excludeEntry)}; std::regex_match(
-                    filePart.string(), excludeRegex)) {
-                    return false;
+            // Files are matched by name with shell-style "*" globs
+            const std::string filePart{filePath.filename().string()};
+            if (fileexcludematcher.matches(filePart)) {
+                return false;
+            }
+
+            if (!fileincludematcher.empty()) {
+                return fileincludematcher.matches(filePart);
+            }
+
+            return true;
+        }
+
+        /**
+         * The instrumentation snippets of the configuration file. A batch
+         * run instruments every input in one process, so the file is read
+         * and parsed for the first input only.
+         */
+        [[nodiscard]] static const InstrumentationMap &getProcessInstrumentationMap() {
+            static const InstrumentationMap instMap = [] {
+                const std::string configPath = getConfigPath();
+                llvm::TimeTraceScope traceScope{"ReadConfig", configPath};
+                return getInstrumentationMap(getConfigYamlTree(configPath));
+            }();
+            return instMap;
+        }
+
+        /**
+         * The phase timings of every input of this process, or null when
+         * $SALT_FORTRAN_TIME_REPORT is unset. The report is printed or
+         * written once, when the process exits.
+         */
+        [[nodiscard]] static salt::TimeReport *getProcessTimeReport() {
+            static const std::string reportPath = [] {
+                if (const char *val = getenv(SALT_FORTRAN_TIME_REPORT_VAR)) {
+                    if (std::string path{val}; path != "0"s) {
+                        return path;
+                    }
                 }
+                return ""s;
+            }();
+            if (reportPath.empty()) {
+                return nullptr;
             }
+            static salt::TimeReport report;
+            static const bool registered = [] {
+                return std::atexit([] {
+                    if (reportPath == "1"s) {
+                        report.print(llvm::errs());
+                    } else {
+                        report.writeJSON(reportPath);
+                    }
+                }) == 0;
+            }();
+            (void) registered;
+            return &report;
+        }
+
+        // The size thresholds of $SALT_FORTRAN_MIN_* and $SALT_FORTRAN_SKIP_LEAF
+        [[nodiscard]] static const salt::SizeThresholds &getProcessSizeThresholds() {
+            static const salt::SizeThresholds thresholds = [] {
+                const auto readCount = [](const char *var) -> unsigned {
+                    const char *val = getenv(var);
+                    return val == nullptr ? 0 : static_cast<unsigned>(std::strtoul(val, nullptr, 10));
+                };
+                salt::SizeThresholds read;
+                read.minStatements = readCount(SALT_FORTRAN_MIN_STATEMENTS_VAR);
+                read.minNodes = readCount(SALT_FORTRAN_MIN_NODES_VAR);
+                read.minLines = readCount(SALT_FORTRAN_MIN_LINES_VAR);
+                const char *skipLeaf = getenv(SALT_FORTRAN_SKIP_LEAF_VAR);
+                read.skipLeaf = skipLeaf != nullptr && skipLeaf != ""s && skipLeaf != "0"s;
+                return read;
+            }();
+            return thresholds;
+        }
 
-            bool fileInIncludeList{false};
-            for (const auto &includeEntry: fileincludelist) {
-                if (const std::regex includeRegex{convertGlobToRegexForm(includeEntry)}; std::regex_match(
-                    filePart.string(), includeRegex)) {
-                    fileInIncludeList = true;
-                    break;
+        /**
+         * The procedures of every input skipped for their size, or null when
+         * $SALT_FORTRAN_SIZE_REPORT is unset. Like the time report, it is
+         * printed or written when the process exits.
+         */
+        [[nodiscard]] static salt::SizeReport *getProcessSizeReport() {
+            static const std::string reportPath = [] {
+                if (const char *val = getenv(SALT_FORTRAN_SIZE_REPORT_VAR)) {
+                    if (std::string path{val}; path != "0"s) {
+                        return path;
+                    }
                 }
+                return ""s;
+            }();
+            if (reportPath.empty()) {
+                return nullptr;
             }
+            static salt::SizeReport report;
+            static const bool registered = [] {
+                return std::atexit([] {
+                    if (reportPath == "1"s) {
+                        report.write(llvm::errs(), getProcessSizeThresholds());
+                    } else {
+                        report.write(llvm::StringRef{reportPath}, getProcessSizeThresholds());
+                    }
+                }) == 0;
+            }();
+            (void) registered;
+            return &report;
+        }
 
-            if (!fileincludelist.empty()) {
-                if (fileInIncludeList) {
-                    return true;
+        /**
+         * Whether $SALT_FORTRAN_TIME_TRACE asked for a Chrome trace. The
+         * profiler is started by the first call, and the trace is written
+         * when the process exits.
+         */
+        [[nodiscard]] static bool startProcessTimeTrace() {
+            static const bool tracing = [] {
+                const char *val = getenv(SALT_FORTRAN_TIME_TRACE_VAR);
+                if (val == nullptr || val == ""s || val == "0"s) {
+                    return false;
                 }
-                return false;
+                llvm::timeTraceProfilerInitialize(SALT_FORTRAN_TIME_TRACE_GRANULARITY, "flang-new");
+                std::atexit([] {
+                    endFrontendTrace();
+                    const std::string path{getenv(SALT_FORTRAN_TIME_TRACE_VAR)};
+                    if (llvm::Error error = llvm::timeTraceProfilerWrite(path == "1"s ? ""s : path,
+                                                                         SALT_FORTRAN_TIME_TRACE_DEFAULT_NAME)) {
+                        llvm::logAllUnhandledErrors(std::move(error), llvm::errs(),
+                                                    "ERROR: Could not write time trace: ");
+                    }
+                    llvm::timeTraceProfilerCleanup();
+                });
+                return true;
+            }();
+            return tracing;
+        }
+
+        // Flang prescans, parses and checks each input before executeAction();
+        // that time is traced as one "Frontend" section per input.
+        static bool &frontendTraceOpen() {
+            static bool open{false};
+            return open;
+        }
+
+        static void beginFrontendTrace() {
+            if (startProcessTimeTrace() && !frontendTraceOpen()) {
+                llvm::timeTraceProfilerBegin("Frontend", "");
+                frontendTraceOpen() = true;
             }
+        }
 
-            return true;
+        static void endFrontendTrace() {
+            if (frontendTraceOpen()) {
+                llvm::timeTraceProfilerEnd();
+                frontendTraceOpen() = false;
+            }
         }
 
         static void dumpSelectiveRequests() {
@@ -1028,10 +1525,18 @@ namespace salt::fortran {
             std::for_each(excludelist.cbegin(), excludelist.cend(), printStr);
         }
 
+    public:
+        SaltInstrumentAction() {
+            beginFrontendTrace();
+        }
+
+    private:
         /**
          * This is the entry point for the plugin.
          */
         void executeAction() override {
+            endFrontendTrace();
+
             if (const char *val = getenv(SALT_FORTRAN_VERBOSE_VAR)) {
                 if (const std::string verboseFlag{val}; !verboseFlag.empty() && verboseFlag != "0"s) {
                     enableVerbose();
@@ -1044,30 +1549,49 @@ namespace salt::fortran {
             // and the source
             Fortran::parser::Parsing &parsing = getParsing();
 
-            // Get the path to the input file
-            const auto inputFilePathStr = getInputFilePath(parsing);
-            if (!inputFilePathStr) {
+            // Get the input file, as read by flang
+            const Fortran::parser::SourceFile *inputFile = getInputSourceFile(parsing);
+            if (inputFile == nullptr) {
                 llvm::errs() << "ERROR: Unable to find input file name!\n";
                 std::exit(-1);
             }
 
-            verboseStream() << "Have input file: " << *inputFilePathStr << "\n";
+            verboseStream() << "Have input file: " << inputFile->path() << "\n";
 
-            const std::filesystem::path inputFilePath{inputFilePathStr.value()};
+            const std::filesystem::path inputFilePath{inputFile->path()};
+            llvm::timeTraceProfilerBegin("SaltInstrumentAction", inputFile->path());
 
-            // Read and parse the yaml configuration file
-            const std::string configPath{getConfigPath()};
-            const ryml::Tree yamlTree = getConfigYamlTree(configPath);
-            const InstrumentationMap instMap = getInstrumentationMap(yamlTree);
+            // Flang parsed and checked this input before calling us
+            salt::TimeReport *report = getProcessTimeReport();
+            salt::FileTiming timing;
+            timing.file = inputFilePath.string();
+            timing[salt::Phase::Parse] = salt::TimeStamp::now() - parseStart_;
+            salt::FileTiming *timed = report != nullptr ? &timing : nullptr;
+            // Set up before the walk, so that a report is written even if nothing is skipped
+            (void) getProcessSizeReport();
 
-            if (const auto selectPath{getSelectFilePath()}; selectPath.has_value()) {
+            // Read and parse the yaml configuration file
+            salt::PhaseTimer configTimer{timed, salt::Phase::Config};
+            const InstrumentationMap &instMap = getProcessInstrumentationMap();
+            configTimer.stop();
+
+            // Like the configuration, the select file is read for the first input only
+            salt::PhaseTimer selectTimer{timed, salt::Phase::Select};
+            static bool selectFileRead{false};
+            if (const auto selectPath{getSelectFilePath()}; selectPath.has_value() && !selectFileRead) {
+                selectFileRead = true;
+                llvm::TimeTraceScope traceScope{"ReadSelectFile", *selectPath};
                 if (processInstrumentationRequests(selectPath->c_str())) {
                     dumpSelectiveRequests();
+                    if (!looplist.empty()) {
+                        llvm::errs() << "WARNING: the select file's loops commands only apply to C and C++\n";
+                    }
                 } else {
                     llvm::errs() << "ERROR: Unable to read selective instrumentation file at " << selectPath << "\n";
                     std::exit(-4);
                 }
             }
+            applyProcessProfileReduction();
 
             // Get the extension of the input file
             // For input file 'filename.ext' we will output to 'filename.inst.Ext'
@@ -1096,17 +1620,68 @@ namespace salt::fortran {
                         << " due to selective instrumentation.\n";
                 skipInstrument = true;
             }
+            selectTimer.stop();
+
             // Walk the parse tree -- marks nodes for instrumentation
-            SaltInstrumentParseTreeVisitor visitor{&parsing, skipInstrument};
-            Walk(parsing.parseTree(), visitor);
+            salt::PhaseTimer visitTimer{timed, salt::Phase::Visit};
+            // Named after the resolved path, like cparse-llvm's tables, so that
+            // one file gets one name however it was spelled
+            llvm::SmallString<256> realPath;
+            if (llvm::sys::fs::real_path(inputFile->path(), realPath)) {
+                realPath = inputFile->path();
+            }
+            const std::string timerTable{"salt_"s + llvm::utohexstr(llvm::xxh3_64bits(
+                                                          llvm::arrayRefFromStringRef(realPath.str())),
+                                                      /*LowerCase=*/true)};
+            SaltInstrumentParseTreeVisitor visitor{&parsing, skipInstrument, timerTable};
+            if (getProcessGroups().has_value()) {
+                llvm::TimeTraceScope traceScope{"CalledNames"};
+                CalledNameVisitor calledNameVisitor;
+                Walk(parsing.parseTree(), calledNameVisitor);
+                visitor.setCalledNames(std::move(calledNameVisitor.names));
+            }
+            {
+                llvm::TimeTraceScope traceScope{"Walk"};
+                Walk(parsing.parseTree(), visitor);
+            }
+            visitTimer.stop();
 
             // Use the instrumentation points stored in the Visitor to write the instrumented file.
-            instrumentFile(inputFilePath, *outputFileStream, visitor, instMap);
+            salt::PhaseTimer rewriteTimer{timed, salt::Phase::Rewrite};
+            {
+                llvm::TimeTraceScope traceScope{"instrumentFile", inputFile->path()};
+                instrumentFile(*inputFile, inputFilePath, *outputFileStream, visitor, instMap);
+                outputFileStream->flush();
+            }
+            if (getProcessTimerIds()) {
+                // Next to the instrumented file, wherever -o put it
+                std::string outputPath{getInstance().getFrontendOpts().outputFile};
+                if (outputPath.empty() || outputPath == "-"s) {
+                    outputPath = std::filesystem::path{inputFilePath}.replace_extension(outputFileExtension).string();
+                }
+                if (!writeTimerTable(outputPath + ".timers"s, inputFilePath.string(), visitor)) {
+                    // The output's timer keys cannot be resolved without it
+                    llvm::errs() << "ERROR: could not write the timer table " << outputPath << ".timers\n";
+                    std::exit(-1);
+                }
+            }
+            rewriteTimer.stop();
 
-            outputFileStream->flush();
+            if (report != nullptr) {
+                timing.functionsVisited = visitor.proceduresVisited();
+                timing.functionsInstrumented = visitor.proceduresInstrumented();
+                report->add(std::move(timing));
+            }
+            llvm::timeTraceProfilerEnd();
+            // A batch parses the next input after this one returns
+            parseStart_ = salt::TimeStamp::now();
+            beginFrontendTrace();
 
             verboseStream() << "==== SALT Instrumentor Plugin finished ====\n";
         }
+
+        // When flang started parsing the current input
+        salt::TimeStamp parseStart_{salt::TimeStamp::now()};
     };
 }
 
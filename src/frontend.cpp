@@ -14,20 +14,36 @@
 #include "clang/Basic/SourceManager.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "clang/Tooling/CompilationDatabase.h"
 #include "llvm/Config/llvm-config.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <cstdlib>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <vector>
 
 #include "selectfile.hpp"
+#include "inst_cache.hpp"
+#include "inst_server.hpp"
+#include "profile_reduce.hpp"
+#include "size_filter.hpp"
+#include "time_report.hpp"
 
 using namespace clang;
 
@@ -91,8 +107,166 @@ llvm::cl::opt<std::string> selectfile("tau_select_file",
                                       llvm::cl::desc("Provide a selective instrumentation specification file"),
                                       llvm::cl::value_desc("filename"), llvm::cl::cat(MyToolCategory));
 
+llvm::cl::opt<unsigned> jobs("j",
+                             llvm::cl::desc("Number of source files to instrument in parallel "
+                                            "(default: 1, 0: use all hardware threads)"),
+                             llvm::cl::value_desc("N"), llvm::cl::init(1), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<std::string> batchdir("batch",
+                                    llvm::cl::desc("Instrument every source in the compilation database "
+                                                   "(compile_commands.json) found in <dir>, writing each "
+                                                   "instrumented file next to its source"),
+                                    llvm::cl::value_desc("dir"), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<std::string> manifestfile("manifest",
+                                        llvm::cl::desc("Write a JSON manifest of the files produced to <filename>"),
+                                        llvm::cl::value_desc("filename"), llvm::cl::cat(MyToolCategory));
+
+std::string getEnvCacheDir() {
+    char *val = getenv("SALT_CACHE_DIR");
+    return val == NULL ? std::string() : std::string(val);
+}
+
+llvm::cl::opt<std::string> cachedir("cache_dir",
+                                    llvm::cl::desc("Reuse instrumented outputs cached in <dir> when the preprocessed "
+                                                   "source, config and select file are unchanged "
+                                                   "(default: $SALT_CACHE_DIR, unset disables caching)"),
+                                    llvm::cl::value_desc("dir"), llvm::cl::init(getEnvCacheDir()),
+                                    llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<std::string> timereport("salt_time_report",
+                                      llvm::cl::desc("Report the time spent in each phase of instrumenting every "
+                                                     "file; print a table to stderr, or write JSON to filename"),
+                                      llvm::cl::value_desc("filename"), llvm::cl::ValueOptional,
+                                      llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<std::string> timetrace("salt_time_trace",
+                                     llvm::cl::desc("Write a Chrome trace (chrome://tracing) of the clang frontend "
+                                                    "and of SALT's own phases to filename "
+                                                    "(default: salt-fm.time-trace)"),
+                                     llvm::cl::value_desc("filename"), llvm::cl::ValueOptional,
+                                     llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<unsigned> timetracegranularity("salt_time_trace_granularity",
+                                             llvm::cl::desc("Minimum time in microseconds of the events kept "
+                                                            "in the --salt_time_trace output (default: 500)"),
+                                             llvm::cl::value_desc("us"), llvm::cl::init(500),
+                                             llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<unsigned> min_statements("salt_min_statements",
+                                       llvm::cl::desc("Do not instrument functions with fewer than N statements"),
+                                       llvm::cl::value_desc("N"), llvm::cl::init(0), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<unsigned> min_nodes("salt_min_nodes",
+                                  llvm::cl::desc("Do not instrument functions whose body has fewer than N AST nodes"),
+                                  llvm::cl::value_desc("N"), llvm::cl::init(0), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<unsigned> min_lines("salt_min_lines",
+                                  llvm::cl::desc("Do not instrument functions whose body spans fewer than N lines"),
+                                  llvm::cl::value_desc("N"), llvm::cl::init(0), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<bool> skip_leaf("salt_skip_leaf",
+                              llvm::cl::desc("Do not instrument functions that contain neither a loop nor a call"),
+                              llvm::cl::init(false), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<std::string> sizereport("salt_size_report",
+                                      llvm::cl::desc("List the functions skipped by --salt_min_* and "
+                                                     "--salt_skip_leaf, as a select file excluding them; print "
+                                                     "it to stderr, or write it to filename"),
+                                      llvm::cl::value_desc("filename"), llvm::cl::ValueOptional,
+                                      llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<bool> timer_ids("salt_timer_ids",
+                              llvm::cl::desc("Emit \"<table>:<index>\" for ${full_timer_name} and write the full "
+                                             "names to a <output>.timers table next to each output"),
+                              llvm::cl::init(false), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<bool> throttle("salt_throttle",
+                             llvm::cl::desc("Guard every probe with a per-function counter that turns it off once "
+                                            "the function made --salt_throttle_calls calls averaging less than "
+                                            "--salt_throttle_usec"),
+                             llvm::cl::init(false), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<unsigned> throttle_calls("salt_throttle_calls",
+                                       llvm::cl::desc("Calls a --salt_throttle guard counts before it may turn its "
+                                                      "probe off (default: 100000)"),
+                                       llvm::cl::value_desc("N"), llvm::cl::init(100000),
+                                       llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<double> throttle_usec("salt_throttle_usec",
+                                    llvm::cl::desc("Time per call in microseconds below which a --salt_throttle "
+                                                   "guard turns its probe off (default: 10)"),
+                                    llvm::cl::value_desc("us"), llvm::cl::init(10),
+                                    llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<bool> groups("salt_groups",
+                           llvm::cl::desc("Wrap the probes of each function in #if SALT_GROUP_<NAME>, where NAME is "
+                                          "MAIN, SMALL, LEAF, TOP or INTERIOR, so groups can be compiled out with "
+                                          "-DSALT_GROUP_<NAME>=0"),
+                           llvm::cl::init(false), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<unsigned> group_small("salt_group_small",
+                                    llvm::cl::desc("Statements below which --salt_groups puts a function in the "
+                                                   "SMALL group (default: 4)"),
+                                    llvm::cl::value_desc("N"), llvm::cl::init(4), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<bool> enable_table("salt_enable_table",
+                                 llvm::cl::desc("Run each probe only if its function's bit in a generated table is "
+                                                "set, switched at run time with $SALT_ENABLE or the salt-enable "
+                                                "library (C/C++)"),
+                                 llvm::cl::init(false), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::list<std::string> profilepaths("salt_profile",
+                                         llvm::cl::desc("Do not instrument the functions of a previous run's "
+                                                        "profile that match a --salt_reduce_rule: TAU profile.* "
+                                                        "files, a directory of them, or a CSV of "
+                                                        "name,calls,inclusive_usec"),
+                                         llvm::cl::value_desc("path"), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::list<std::string> reducerules("salt_reduce_rule",
+                                        llvm::cl::desc("Exclude the --salt_profile functions matching rule, e.g. "
+                                                       "\"calls > 1e6 && usec/call < 2\" (the default); fields "
+                                                       "are calls, subrs, usec, cumusec, usec/call, cumusec/call"),
+                                        llvm::cl::value_desc("rule"), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<std::string> reduceoutput("salt_reduce_output",
+                                        llvm::cl::desc("Write the functions excluded by --salt_profile as a "
+                                                       "selective instrumentation file"),
+                                        llvm::cl::value_desc("filename"), llvm::cl::cat(MyToolCategory));
+
+llvm::cl::opt<std::string> servesocket("serve",
+                                       llvm::cl::desc("Keep running and instrument the requests of later "
+                                                      "invocations sent over <socket> (default: "
+                                                      "$SALT_SERVER_SOCKET, or a per-user socket)"),
+                                       llvm::cl::value_desc("socket"), llvm::cl::ValueOptional,
+                                       llvm::cl::cat(MyToolCategory));
+
 #include "clang_header_includes.h"
 
+// The headers of the include directories added by addHeadersToCommand(),
+// shared by every ClangTool of the process
+header_cache &systemHeaders()
+{
+    static header_cache cache([] {
+        std::vector<std::string> dirs;
+        for (int i = 0; i < clang_header_includes_length; i++)
+        {
+            llvm::StringRef arg(clang_header_includes[i]);
+            if (arg.starts_with("-I"))
+            {
+                dirs.push_back(arg.drop_front(2).str());
+            }
+            else if ((arg == "-isysroot" || arg == "-resource-dir") && i + 1 < clang_header_includes_length)
+            {
+                dirs.push_back(clang_header_includes[++i]);
+            }
+        }
+        dirs.push_back("/usr/include");
+        return dirs;
+    }());
+    return cache;
+}
+
 char **addHeadersToCommand(int *argc, const char **argv)
 {
     // first, check for no arguments.    If none, add --help
@@ -154,7 +328,8 @@ char **addHeadersToCommand(int *argc, const char **argv)
     return new_argv;
 }
 
-void findFiles(const std::vector<std::string>& files, instrumentor& CI)
+// Returns false if there is no file to instrument
+bool findFiles(const std::vector<std::string>& files, instrumentor& CI)
 {
     for (auto fname : files)
     {
@@ -175,48 +350,44 @@ void findFiles(const std::vector<std::string>& files, instrumentor& CI)
     {
         if (!fileincludelist.empty())
         {
-            if (check_file_against_list(fileincludelist, fil) && !check_file_against_list(fileexcludelist, fil))
+            if (check_file_against_list(fileincludematcher, fil) && !check_file_against_list(fileexcludematcher, fil))
             {
-                if (!fil.empty() && std::find(files_to_go.begin(), files_to_go.end(), fil) == files_to_go.end())
+                if (!fil.empty() && std::find(CI.files_to_go.begin(), CI.files_to_go.end(), fil) == CI.files_to_go.end())
                 {
-                    files_to_go.push_back(fil);
+                    CI.files_to_go.push_back(fil);
                 }
             }
             else
             {
-                files_skipped.push_back(fil);
+                CI.files_skipped.push_back(fil);
             }
         }
         else
         {
-            if (!check_file_against_list(fileexcludelist, fil))
+            if (!check_file_against_list(fileexcludematcher, fil))
             {
-                if (!fil.empty() && std::find(files_to_go.begin(), files_to_go.end(), fil) == files_to_go.end())
+                if (!fil.empty() && std::find(CI.files_to_go.begin(), CI.files_to_go.end(), fil) == CI.files_to_go.end())
                 {
-                    files_to_go.push_back(fil);
+                    CI.files_to_go.push_back(fil);
                 }
             }
             else
             {
-                files_skipped.push_back(fil);
+                CI.files_skipped.push_back(fil);
             }
         }
     }
 
     if (files.size() < 1)
     {
-        fprintf(stderr, "ERROR: no file to instrument, exiting.");
-        exit(0);
+        fprintf(stderr, "ERROR: no file to instrument.\n");
+        return false;
     }
-    // unique requires things to be sorted, even though this doesn't really make sense at this point
-    std::sort(inst_locs.begin(), inst_locs.end(), comp_inst_loc);
-
-    // sometimes pre-declarations cause duplicates, yeet them
-    auto new_end = std::unique(inst_locs.begin(), inst_locs.end(), eq_inst_loc);
-    inst_locs.erase(new_end, inst_locs.end());
+    // Duplicate locations are dropped per file by instrument(), which has to
+    // sort each file's locations anyway
 
     // sort on filename excluding path
-    std::sort(files_to_go.begin(), files_to_go.end(), [&](std::string s1, std::string s2) {
+    std::sort(CI.files_to_go.begin(), CI.files_to_go.end(), [&](std::string s1, std::string s2) {
         std::string temp1, temp2;
         // handle s1
         if (s1.find("/") != std::string::npos)
@@ -241,7 +412,7 @@ void findFiles(const std::vector<std::string>& files, instrumentor& CI)
         return temp1 < temp2;
     });
 
-    auto new_end2 = std::unique(files_to_go.begin(), files_to_go.end(), [&](std::string s1, std::string s2) {
+    auto new_end2 = std::unique(CI.files_to_go.begin(), CI.files_to_go.end(), [&](std::string s1, std::string s2) {
         std::string temp1, temp2;
         temp1 = s1;
         temp2 = s2;
@@ -259,9 +430,248 @@ void findFiles(const std::vector<std::string>& files, instrumentor& CI)
         return (temp1.find(temp2) != std::string::npos || temp2.find(temp1) != std::string::npos);
     });
 
-    files_to_go.erase(new_end2, files_to_go.end());
+    CI.files_to_go.erase(new_end2, CI.files_to_go.end());
+    return true;
 }
 
+// Write a cached output in place of parsing and rewriting source
+void emitCachedOutput(const std::string &source, const std::string &output, const inst_cache_entry &entry,
+                      std::vector<inst_output> &outputs)
+{
+    std::ofstream inst_file(output);
+    inst_file << entry.content;
+    inst_file.close();
+
+    if (entry.instrumented)
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        llvm::outs() << "Instrumentation: " << entry.instrumentation << " (cached)\n";
+        llvm::outs().flush();
+    }
+    outputs.push_back({source, output, entry.instrumented, entry.instrumentation});
+}
+
+// instrumentSource() status of a translation unit whose outputs could not be
+// produced, e.g. for want of a config. It fails the request even outside a
+// batch, where a parse error alone does not.
+const int instrumentFailed = -1;
+
+// Parse, select and rewrite a single source file with its own ClangTool.
+// Each tool gets a private physical file system so that the working directory
+// of one compile command does not leak into tools running on other threads;
+// system headers are still read once per process through systemHeaders().
+// Returns the ClangTool status, or instrumentFailed if the outputs could not
+// be written, and appends the files written to outputs.
+// When report is given, the time spent in each phase is added to it, and when
+// size_report is given, the functions skipped for their size.
+int instrumentSource(const tooling::CompilationDatabase &compilations, const std::string &source,
+                     const char *exec_name, std::vector<inst_output> &outputs, inst_cache *cache,
+                     salt::TimeReport *report, salt::SizeReport *size_report)
+{
+    llvm::TimeTraceScope trace_scope("InstrumentSource", source);
+    salt::FileTiming timing;
+    timing.file = source;
+
+    instrumentor CodeInstrumentor;
+    if (report != nullptr)
+    {
+        CodeInstrumentor.timing = &timing;
+    }
+    CodeInstrumentor.set_exec_name(exec_name);
+    CodeInstrumentor.inst_inline = do_inline;
+    CodeInstrumentor.inst_beside_source = !batchdir.empty();
+    CodeInstrumentor.size_thresholds = {min_statements, min_nodes, min_lines, skip_leaf};
+    CodeInstrumentor.size_report = size_report;
+
+    std::string key;
+    bool cxx_api = (use_cxx_api || strstr(exec_name, "cxxparse") != nullptr) && !throttle && !enable_table;
+    // A cached output would leave its skipped functions out of the size report,
+    // and only holds the instrumented file, not its timer table
+    bool cacheable = cache != nullptr && size_report == nullptr && !timer_ids &&
+                     cache->compute_key(compilations, source, cxx_api, key);
+    inst_cache_entry entry;
+    if (cacheable && cache->lookup(key, entry))
+    {
+        emitCachedOutput(source, CodeInstrumentor.inst_file_name(source), entry, outputs);
+        if (report != nullptr)
+        {
+            report->add(std::move(timing));
+        }
+        return 0;
+    }
+
+    CodeInstrumentor.Tool = new tooling::ClangTool(compilations, {source},
+                                                   std::make_shared<PCHContainerOperations>(),
+                                                   systemHeaders().file_system());
+    salt::PhaseTimer parse_timer(CodeInstrumentor.timing, salt::Phase::Parse);
+    int status = CodeInstrumentor.run_tool();
+    parse_timer.stop();
+    // The AST is visited from inside the tool run, which was counted as parsing
+    timing[salt::Phase::Parse] -= timing[salt::Phase::Visit];
+    timing.functionsVisited = CodeInstrumentor.funcs.size();
+
+    salt::PhaseTimer select_timer(CodeInstrumentor.timing, salt::Phase::Select);
+    CodeInstrumentor.instr_request(excludematcher, false); // Emit selective instrumentation requests
+
+    bool found;
+    {
+        llvm::TimeTraceScope find_scope("findFiles");
+        found = findFiles({source}, CodeInstrumentor); //Locate source files and mark for instrumentation/skipping
+    }
+    select_timer.stop();
+
+    if (!found || !CodeInstrumentor.instrument())
+    {
+        status = instrumentFailed;
+    }
+
+    // Only a clean parse that produced exactly this source's output is reusable
+    if (cacheable && status == 0 && CodeInstrumentor.outputs.size() == 1)
+    {
+        const inst_output &out = CodeInstrumentor.outputs.front();
+        if (auto buffer = llvm::MemoryBuffer::getFile(out.output))
+        {
+            cache->store(key, {out.instrumented, out.instrumentation, (*buffer)->getBuffer().str()});
+        }
+    }
+
+    outputs = std::move(CodeInstrumentor.outputs);
+    if (report != nullptr)
+    {
+        report->add(std::move(timing));
+    }
+    return status;
+}
+
+// Load the compilation database for batch mode. Its compile commands replace
+// the ones given after "--", so the clang resource headers are appended here.
+std::unique_ptr<tooling::CompilationDatabase> loadBatchCompilations(const std::string &dir)
+{
+    std::string error;
+    std::unique_ptr<tooling::CompilationDatabase> db = tooling::CompilationDatabase::autoDetectFromDirectory(dir, error);
+    if (!db)
+    {
+        llvm::errs() << "ERROR: " << error << "\n";
+        return nullptr;
+    }
+
+    tooling::CommandLineArguments headers(clang_header_includes, clang_header_includes + clang_header_includes_length);
+    auto adjusted = std::make_unique<tooling::ArgumentsAdjustingCompilations>(std::move(db));
+    adjusted->appendArgumentsAdjuster(
+        tooling::getInsertArgumentAdjuster(headers, tooling::ArgumentInsertPosition::END));
+    return adjusted;
+}
+
+struct SourceResult {
+    std::string source;
+    int status = 0;
+    std::vector<inst_output> outputs;
+};
+
+bool writeManifest(const std::string &fname, const std::vector<SourceResult> &results)
+{
+    std::error_code ec;
+    llvm::raw_fd_ostream os(fname, ec);
+    if (ec)
+    {
+        llvm::errs() << "ERROR: Could not open manifest file " << fname << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    llvm::json::OStream J(os, 2);
+    J.object([&] {
+        J.attribute("salt_version", SALT_VERSION_FULL);
+        J.attribute("config_file", configfile.getValue());
+        J.attribute("select_file", selectfile.getValue());
+        J.attributeArray("sources", [&] {
+            for (const SourceResult &result : results)
+            {
+                J.object([&] {
+                    J.attribute("source", result.source);
+                    J.attribute("status", result.status == 0 ? "ok" : "error");
+                    J.attributeArray("outputs", [&] {
+                        for (const inst_output &out : result.outputs)
+                        {
+                            J.object([&] {
+                                J.attribute("file", out.source);
+                                J.attribute("output", out.output);
+                                J.attribute("instrumented", out.instrumented);
+                            });
+                        }
+                    });
+                });
+            }
+        });
+    });
+    os << "\n";
+    return true;
+}
+
+// Adds the --salt_profile functions matching the --salt_reduce_rule rules to
+// the exclude list, after the select file has been read
+bool applyProfileReduction()
+{
+    salt::ProfileReduction reduction;
+    std::string error;
+    for (const std::string &rule : reducerules)
+    {
+        if (!reduction.addRules(rule, error))
+        {
+            llvm::errs() << "ERROR: --salt_reduce_rule: " << error << "\n";
+            return false;
+        }
+    }
+    if (!reduction.hasRules())
+    {
+        reduction.addRules(salt::ProfileReduction::defaultRule, error);
+    }
+    for (const std::string &path : profilepaths)
+    {
+        if (!reduction.readProfile(path, error))
+        {
+            llvm::errs() << "ERROR: --salt_profile: " << error << "\n";
+            return false;
+        }
+    }
+
+    std::list<std::string> excluded = reduction.excludedRoutines();
+    llvm::outs() << "SALT profile reduction: " << excluded.size() << " of " << reduction.profiledRoutines()
+                 << " profiled routines excluded\n";
+    addExcludedRoutines(excluded);
+    return reduceoutput.empty() || reduction.write(reduceoutput);
+}
+
+// Whether argv asks for something the client must do itself rather than
+// forward to a server
+bool runsLocally(int argc, const char **argv)
+{
+    if (argc < 2)
+    {
+        return true;
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        llvm::StringRef arg(argv[i]);
+        if (arg == "--")
+        {
+            break;
+        }
+        if (!arg.starts_with("-"))
+        {
+            continue; // a source file, such as server.c or helpers.c
+        }
+        const llvm::StringRef name = arg.ltrim('-').split('=').first;
+        if (name == "serve" || name == "help" || name == "help-hidden" || name == "help-list" ||
+            name == "help-list-hidden" || name == "version")
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int runRequest(int argc, const char **argv, bool serving);
+
 int main(int argc, const char **argv)
 {
     llvm::cl::SetVersionPrinter([](llvm::raw_ostream &OS) {
@@ -274,12 +684,25 @@ int main(int argc, const char **argv)
 #endif
     });
 
+    // Hand the whole command line to a running server, if there is one
+    int status;
+    if (!runsLocally(argc, argv) && forward_to_server(server_socket_path(), argc, argv, status))
+    {
+        return status;
+    }
+    return runRequest(argc, argv, false);
+}
+
+// Instrument the sources named by one command line. A server calls this once
+// per request, so options are parsed afresh each time.
+int runRequest(int argc, const char **argv, bool serving)
+{
     int new_argc = argc;
     char **new_argv = addHeadersToCommand(&new_argc, argv);
 
     //Get source paths
     auto ExpectedParser =
-        tooling::CommonOptionsParser::create(new_argc, (const char **)new_argv, MyToolCategory, llvm::cl::OneOrMore,
+        tooling::CommonOptionsParser::create(new_argc, (const char **)new_argv, MyToolCategory, llvm::cl::ZeroOrMore,
                                              "Tool for adding TAU instrumentation to source files.\nNote that this "
                                              "will only instrument the first source file given.");
 
@@ -290,23 +713,238 @@ int main(int argc, const char **argv)
     }
 
     tooling::CommonOptionsParser &OptionsParser = ExpectedParser.get();
-    instrumentor CodeInstrumentor;
-    CodeInstrumentor.Tool = new tooling::ClangTool(OptionsParser.getCompilations(), OptionsParser.getSourcePathList());
-    CodeInstrumentor.set_exec_name(argv[0]);
 
-    inst_inline = do_inline;
+    if (serving)
+    {
+        // System headers may have been upgraded since the previous request
+        systemHeaders().revalidate();
+
+        // Parsing restores the defaults read from the server's environment
+        if (configfile.getNumOccurrences() == 0)
+        {
+            configfile = getEnvCfgFile();
+        }
+        if (cachedir.getNumOccurrences() == 0)
+        {
+            cachedir = getEnvCacheDir();
+        }
+        if (servesocket.getNumOccurrences() > 0)
+        {
+            llvm::errs() << "ERROR: --serve cannot be sent to a server.\n";
+            return 1;
+        }
+    }
+    else if (servesocket.getNumOccurrences() > 0)
+    {
+        std::string socket = servesocket.empty() ? server_socket_path() : servesocket.getValue();
+        return run_server(socket, [](int request_argc, const char **request_argv) {
+            return runRequest(request_argc, request_argv, true);
+        });
+    }
+
+    std::vector<std::string> sources = OptionsParser.getSourcePathList();
+    const tooling::CompilationDatabase *compilations = nullptr;
+    std::unique_ptr<tooling::CompilationDatabase> batchCompilations;
+
+    if (!batchdir.empty())
+    {
+        if (!outputfile.empty())
+        {
+            llvm::errs() << "ERROR: --tau_output cannot be combined with --batch.\n";
+            return 1;
+        }
+        batchCompilations = loadBatchCompilations(batchdir);
+        if (!batchCompilations)
+        {
+            return 1;
+        }
+        compilations = batchCompilations.get();
+        // Explicit sources restrict the batch to those files
+        if (sources.empty())
+        {
+            sources = compilations->getAllFiles();
+        }
+    }
+    else
+    {
+        compilations = &OptionsParser.getCompilations();
+    }
+
+    if (sources.empty())
+    {
+        llvm::errs() << "ERROR: no file to instrument, pass a source file or --batch=<dir>.\n";
+        return 1;
+    }
+
+    // A scoped timer cannot be skipped by the --salt_throttle guard or the
+    // --salt_enable_table test, so these use TAU's C API
+    if (throttle || enable_table)
+    {
+        const char *guard = throttle ? "--salt_throttle" : "--salt_enable_table";
+        if (use_cxx_api)
+        {
+            llvm::errs() << "ERROR: --tau_use_cxx_api cannot be combined with " << guard << ".\n";
+            return 1;
+        }
+        if (strstr(argv[0], "cxxparse") != nullptr)
+        {
+            llvm::errs() << "WARNING: " << guard << " instruments with the C API instead of " << argv[0]
+                         << "'s C++ API\n";
+        }
+    }
+
+    // The selective instrumentation lists are only read after this point, so
+    // they can be shared by all workers.
+    std::unique_ptr<salt::TimeReport> report;
+    if (timereport.getNumOccurrences() > 0)
+    {
+        report = std::make_unique<salt::TimeReport>();
+    }
 
+    std::unique_ptr<salt::SizeReport> size_report;
+    if (sizereport.getNumOccurrences() > 0)
+    {
+        size_report = std::make_unique<salt::SizeReport>();
+    }
+
+    // Every thread that instruments a source records its own part of the trace
+    bool tracing = timetrace.getNumOccurrences() > 0;
+    if (tracing)
+    {
+        llvm::timeTraceProfilerInitialize(timetracegranularity, argv[0]);
+    }
+
+    resetInstrumentationRequests();
     if (!selectfile.empty())
     {
-        processInstrumentationRequests(selectfile.c_str());
+        // Read once for every source, so it gets a row of its own
+        salt::FileTiming timing;
+        timing.file = selectfile;
+        salt::PhaseTimer select_timer(&timing, salt::Phase::Select);
+        {
+            llvm::TimeTraceScope trace_scope("ReadSelectFile", selectfile.getValue());
+            if (!processInstrumentationRequests(selectfile.c_str()))
+            {
+                if (tracing)
+                {
+                    llvm::timeTraceProfilerCleanup();
+                }
+                return 1;
+            }
+        }
+        select_timer.stop();
+        if (report)
+        {
+            report->add(std::move(timing));
+        }
+    }
+    if (!profilepaths.empty() && !applyProfileReduction())
+    {
+        if (tracing)
+        {
+            llvm::timeTraceProfilerCleanup();
+        }
+        return 1;
+    }
+
+    std::unique_ptr<inst_cache> cache;
+    if (!cachedir.empty())
+    {
+        cache = std::make_unique<inst_cache>(cachedir);
+    }
+
+    // One slot per source, so workers never touch the same element
+    std::vector<SourceResult> results(sources.size());
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        results[i].source = sources[i];
+    }
+
+    if (jobs == 1 || sources.size() < 2)
+    {
+        for (SourceResult &result : results)
+        {
+            result.status = instrumentSource(*compilations, result.source, argv[0], result.outputs, cache.get(),
+                                             report.get(), size_report.get());
+        }
+    }
+    else
+    {
+        llvm::DefaultThreadPool Pool(llvm::hardware_concurrency(jobs));
+        for (SourceResult &result : results)
+        {
+            Pool.async([compilations, &result, argv, &cache, &report, &size_report, tracing] {
+                if (tracing)
+                {
+                    llvm::timeTraceProfilerInitialize(timetracegranularity, argv[0]);
+                }
+                result.status = instrumentSource(*compilations, result.source, argv[0], result.outputs,
+                                                 cache.get(), report.get(), size_report.get());
+                if (tracing)
+                {
+                    // Hands this task's events to the main thread's trace
+                    llvm::timeTraceProfilerFinishThread();
+                }
+            });
+        }
+        Pool.wait();
+    }
+
+    if (tracing)
+    {
+        llvm::Error error = llvm::timeTraceProfilerWrite(timetrace, "salt-fm");
+        llvm::timeTraceProfilerCleanup();
+        if (error)
+        {
+            llvm::logAllUnhandledErrors(std::move(error), llvm::errs(), "ERROR: Could not write time trace: ");
+            return 1;
+        }
+    }
+
+    if (cache)
+    {
+        cache->print_stats();
     }
 
-    CodeInstrumentor.run_tool();
+    if (report)
+    {
+        if (timereport.empty())
+        {
+            report->print(llvm::errs());
+        }
+        else if (!report->writeJSON(timereport))
+        {
+            return 1;
+        }
+    }
 
-    CodeInstrumentor.instr_request(excludelist, false); // Emit selective instrumentation requests
+    if (size_report)
+    {
+        salt::SizeThresholds thresholds{min_statements, min_nodes, min_lines, skip_leaf};
+        if (sizereport.empty())
+        {
+            size_report->write(llvm::errs(), thresholds);
+        }
+        else if (!size_report->write(sizereport, thresholds))
+        {
+            return 1;
+        }
+    }
 
-    findFiles(OptionsParser.getSourcePathList(), CodeInstrumentor); //Locate source files and mark for instrumentation/skipping
+    if (!manifestfile.empty() && !writeManifest(manifestfile, results))
+    {
+        return 1;
+    }
 
-    CodeInstrumentor.instrument();
+    // A batch should fail loudly if any translation unit did not parse, and
+    // any run if an output could not be written
+    for (const SourceResult &result : results)
+    {
+        if (result.status == instrumentFailed || (!batchdir.empty() && result.status != 0))
+        {
+            return 1;
+        }
+    }
 
+    return 0;
 }
@@ -0,0 +1,219 @@
+#include "inst_cache.hpp"
+#include "instrumentor.hpp"
+#include "frontend.hpp"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA256.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <mutex>
+
+#include "dprint.hpp"
+#include "selectfile.hpp"
+
+using namespace clang;
+
+// Bump when the entry format or the set of hashed inputs changes
+#define INST_CACHE_FORMAT "salt-inst-cache-3"
+
+// Length-prefix every field so that adjacent fields cannot run together
+static void hash_field(llvm::SHA256 &hasher, llvm::StringRef name, llvm::StringRef value)
+{
+    hasher.update(name);
+    hasher.update(llvm::StringRef("\0", 1));
+    hasher.update(std::to_string(value.size()));
+    hasher.update(llvm::StringRef("\0", 1));
+    hasher.update(value);
+}
+
+static bool hash_file(llvm::SHA256 &hasher, llvm::StringRef name, const std::string &fname)
+{
+    if (fname.empty())
+    {
+        hash_field(hasher, name, "");
+        return true;
+    }
+    auto buffer = llvm::MemoryBuffer::getFile(fname);
+    if (!buffer)
+    {
+        return false;
+    }
+    hash_field(hasher, name, (*buffer)->getBuffer());
+    return true;
+}
+
+// Hashes the token stream the preprocessor produces for the main file, so
+// edits to included headers or macro definitions change the key while edits
+// to code that is preprocessed away do not.
+class HashPreprocessedAction : public PreprocessorFrontendAction
+{
+    llvm::SHA256 &hasher;
+
+  public:
+    explicit HashPreprocessedAction(llvm::SHA256 &hasher) : hasher(hasher)
+    {
+    }
+
+  protected:
+    void ExecuteAction() override
+    {
+        Preprocessor &PP = getCompilerInstance().getPreprocessor();
+        PP.EnterMainSourceFile();
+        Token tok;
+        PP.Lex(tok);
+        while (tok.isNot(tok::eof))
+        {
+            if (tok.isAtStartOfLine())
+            {
+                hasher.update("\n");
+            }
+            hasher.update(PP.getSpelling(tok));
+            hasher.update(" ");
+            PP.Lex(tok);
+        }
+    }
+};
+
+class HashPreprocessedActionFactory : public tooling::FrontendActionFactory
+{
+    llvm::SHA256 &hasher;
+
+  public:
+    explicit HashPreprocessedActionFactory(llvm::SHA256 &hasher) : hasher(hasher)
+    {
+    }
+
+    std::unique_ptr<FrontendAction> create() override
+    {
+        return std::make_unique<HashPreprocessedAction>(hasher);
+    }
+};
+
+inst_cache::inst_cache(std::string dir) : dir(std::move(dir))
+{
+}
+
+bool inst_cache::compute_key(const tooling::CompilationDatabase &compilations, const std::string &source,
+                             bool cxx_api, std::string &key) const
+{
+    llvm::SHA256 hasher;
+    hash_field(hasher, "format", INST_CACHE_FORMAT);
+    hash_field(hasher, "salt", SALT_VERSION_FULL);
+    hash_field(hasher, "llvm", LLVM_VERSION_STRING);
+    // The timer names and #line directives embed the path as given
+    hash_field(hasher, "source", source);
+    hash_field(hasher, "cxx_api", cxx_api ? "1" : "0");
+    hash_field(hasher, "inline", do_inline ? "1" : "0");
+    hash_field(hasher, "size", std::to_string(min_statements) + " " + std::to_string(min_nodes) + " " +
+                                   std::to_string(min_lines) + " " + (skip_leaf ? "1" : "0"));
+    hash_field(hasher, "throttle", throttle ? std::to_string(throttle_calls) + " " + std::to_string(throttle_usec)
+                                            : std::string("0"));
+    hash_field(hasher, "groups", groups ? std::to_string(group_small) : std::string("0"));
+    hash_field(hasher, "enable", enable_table ? "1" : "0");
+
+    // Comments and layout are copied into the output verbatim, so the raw
+    // text matters in addition to the token stream.
+    if (!hash_file(hasher, "raw", source) || !hash_file(hasher, "config", configfile) ||
+        !hash_file(hasher, "select", selectfile))
+    {
+        return false;
+    }
+
+    // Covers the routines --salt_profile added to those of the select file
+    for (const std::string &routine : excludelist)
+    {
+        hash_field(hasher, "exclude", routine);
+    }
+
+    for (const tooling::CompileCommand &command : compilations.getCompileCommands(source))
+    {
+        hash_field(hasher, "directory", command.Directory);
+        for (const std::string &arg : command.CommandLine)
+        {
+            hash_field(hasher, "arg", arg);
+        }
+    }
+
+    // Diagnostics are reported by the real parse on a miss, not twice
+    IgnoringDiagConsumer ignore_diags;
+    tooling::ClangTool tool(compilations, {source}, std::make_shared<PCHContainerOperations>(),
+                            llvm::vfs::createPhysicalFileSystem());
+    tool.setDiagnosticConsumer(&ignore_diags);
+    HashPreprocessedActionFactory factory(hasher);
+    if (tool.run(&factory) != 0)
+    {
+        DPRINT("Not caching %s: preprocessing failed\n", source.c_str());
+        return false;
+    }
+
+    key = llvm::toHex(hasher.final(), true);
+    return true;
+}
+
+std::string inst_cache::entry_path(const std::string &key) const
+{
+    llvm::SmallString<256> path(dir);
+    llvm::sys::path::append(path, key.substr(0, 2), key + ".inst");
+    return std::string(path);
+}
+
+bool inst_cache::lookup(const std::string &key, inst_cache_entry &entry)
+{
+    auto buffer = llvm::MemoryBuffer::getFile(entry_path(key));
+    if (!buffer)
+    {
+        misses++;
+        return false;
+    }
+
+    // "<0|1> <instrumentation>\n<content>"
+    llvm::StringRef data = (*buffer)->getBuffer();
+    auto [header, content] = data.split('\n');
+    auto [flag, instrumentation] = header.split(' ');
+    if (flag != "0" && flag != "1")
+    {
+        misses++;
+        return false;
+    }
+
+    entry.instrumented = flag == "1";
+    entry.instrumentation = instrumentation.str();
+    entry.content = content.str();
+    hits++;
+    return true;
+}
+
+void inst_cache::store(const std::string &key, const inst_cache_entry &entry) const
+{
+    std::string path = entry_path(key);
+    if (std::error_code ec = llvm::sys::fs::create_directories(llvm::sys::path::parent_path(path)))
+    {
+        llvm::errs() << "WARNING: Could not create cache directory for " << path << ": " << ec.message() << "\n";
+        return;
+    }
+
+    // writeToOutput renames a temporary into place, so concurrent writers
+    // and readers never observe a partial entry.
+    llvm::Error err = llvm::writeToOutput(path, [&](llvm::raw_ostream &OS) {
+        OS << (entry.instrumented ? "1" : "0") << " " << entry.instrumentation << "\n" << entry.content;
+        return llvm::Error::success();
+    });
+    if (err)
+    {
+        llvm::errs() << "WARNING: Could not write cache entry " << path << ": " << llvm::toString(std::move(err))
+                     << "\n";
+    }
+}
+
+void inst_cache::print_stats() const
+{
+    llvm::outs() << "SALT cache: " << hits << " hits, " << misses << " misses (" << dir << ")\n";
+}
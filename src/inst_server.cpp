@@ -0,0 +1,584 @@
+#include "inst_server.hpp"
+#include "frontend.hpp"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "dprint.hpp"
+
+// Environment variables that set option defaults or, read by the Clang driver, add include
+// directories, so a request is run with the client's values
+static const char *const forwarded_env[] = {"SALT_CONFIG_FILE", "SALT_CACHE_DIR", "CPATH", "C_INCLUDE_PATH",
+                                            "CPLUS_INCLUDE_PATH", "OBJC_INCLUDE_PATH"};
+
+// Socket to remove when the server is stopped by a signal
+static char serving_path[sizeof(sockaddr_un::sun_path)];
+
+namespace
+{
+// A file whose contents stay in a header_cache for the life of the process
+class cached_file : public llvm::vfs::File
+{
+    llvm::vfs::Status stat;
+    const llvm::MemoryBuffer &buffer;
+
+  public:
+    cached_file(llvm::vfs::Status stat, const llvm::MemoryBuffer &buffer) : stat(std::move(stat)), buffer(buffer)
+    {
+    }
+
+    llvm::ErrorOr<llvm::vfs::Status> status() override
+    {
+        return stat;
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(const llvm::Twine &name, int64_t file_size,
+                                                                 bool requires_null_terminator,
+                                                                 bool is_volatile) override
+    {
+        return llvm::MemoryBuffer::getMemBuffer(buffer.getBuffer(), name.str(), requires_null_terminator);
+    }
+
+    std::error_code close() override
+    {
+        return {};
+    }
+};
+
+class header_cache_fs : public llvm::vfs::ProxyFileSystem
+{
+    header_cache &cache;
+
+  public:
+    header_cache_fs(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs, header_cache &cache)
+        : ProxyFileSystem(std::move(fs)), cache(cache)
+    {
+    }
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &path) override
+    {
+        llvm::SmallString<256> name;
+        path.toVector(name);
+        if (!cache.covers(name))
+        {
+            return ProxyFileSystem::status(path);
+        }
+        return cache.status(name, getUnderlyingFS());
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(const llvm::Twine &path) override
+    {
+        llvm::SmallString<256> name;
+        path.toVector(name);
+        if (!cache.covers(name))
+        {
+            return ProxyFileSystem::openFileForRead(path);
+        }
+        const llvm::MemoryBuffer *buffer = nullptr;
+        llvm::ErrorOr<llvm::vfs::Status> stat = cache.read(name, getUnderlyingFS(), buffer);
+        if (!stat)
+        {
+            return stat.getError();
+        }
+        if (buffer == nullptr)
+        {
+            return ProxyFileSystem::openFileForRead(path);
+        }
+        return std::unique_ptr<llvm::vfs::File>(std::make_unique<cached_file>(*stat, *buffer));
+    }
+};
+
+bool write_all(int fd, llvm::StringRef data)
+{
+    while (!data.empty())
+    {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        data = data.drop_front(written);
+    }
+    return true;
+}
+
+std::string read_all(int fd)
+{
+    std::string data;
+    char chunk[4096];
+    ssize_t got;
+    while ((got = read(fd, chunk, sizeof(chunk))) != 0)
+    {
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        data.append(chunk, got);
+    }
+    return data;
+}
+
+bool make_address(const std::string &socket_path, sockaddr_un &addr)
+{
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return true;
+}
+
+// Returns a socket connected to socket_path, or -1
+int connect_to(const std::string &socket_path)
+{
+    sockaddr_un addr;
+    if (!make_address(socket_path, addr))
+    {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Whether the process at the other end of the connected socket fd runs as this
+// user. The default socket lives in a shared directory when XDG_RUNTIME_DIR is
+// unset, so anyone could have bound it first.
+bool peer_is_self(int fd)
+{
+#ifdef SO_PEERCRED
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+    {
+        return false;
+    }
+    return cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    if (getpeereid(fd, &uid, &gid) != 0)
+    {
+        return false;
+    }
+    return uid == getuid();
+#endif
+}
+
+void stop_serving(int sig)
+{
+    unlink(serving_path);
+    _exit(0);
+}
+
+void flush_output()
+{
+    llvm::outs().flush();
+    llvm::errs().flush();
+    fflush(stdout);
+    fflush(stderr);
+}
+
+// Runs the request {"cwd", "argv", "env"} with out_fd and err_fd as stdout and stderr
+int serve_request(llvm::StringRef text, int out_fd, int err_fd, request_handler handler)
+{
+    llvm::Expected<llvm::json::Value> value = llvm::json::parse(text);
+    if (!value)
+    {
+        llvm::errs() << "SALT server: malformed request: " << llvm::toString(value.takeError()) << "\n";
+        return 1;
+    }
+    const llvm::json::Object *request = value->getAsObject();
+    const llvm::json::Array *args = request != nullptr ? request->getArray("argv") : nullptr;
+    std::optional<llvm::StringRef> cwd = request != nullptr ? request->getString("cwd") : std::nullopt;
+    if (args == nullptr || args->empty() || !cwd)
+    {
+        llvm::errs() << "SALT server: malformed request\n";
+        return 1;
+    }
+
+    std::vector<std::string> arg_storage;
+    for (const llvm::json::Value &arg : *args)
+    {
+        arg_storage.push_back(arg.getAsString().value_or("").str());
+    }
+    std::vector<const char *> argv;
+    for (const std::string &arg : arg_storage)
+    {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    const llvm::json::Object *env = request->getObject("env");
+    for (const char *name : forwarded_env)
+    {
+        std::optional<llvm::StringRef> setting = env != nullptr ? env->getString(name) : std::nullopt;
+        if (setting)
+        {
+            setenv(name, setting->str().c_str(), 1);
+        }
+        else
+        {
+            unsetenv(name);
+        }
+    }
+
+    llvm::SmallString<256> server_cwd;
+    llvm::sys::fs::current_path(server_cwd);
+    if (chdir(cwd->str().c_str()) != 0)
+    {
+        llvm::errs() << "SALT server: cannot enter " << *cwd << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    flush_output();
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+    dup2(err_fd, STDERR_FILENO);
+
+    int status = handler(static_cast<int>(arg_storage.size()), argv.data());
+
+    flush_output();
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    if (chdir(server_cwd.c_str()) != 0)
+    {
+        llvm::errs() << "SALT server: cannot return to " << server_cwd << "\n";
+    }
+
+    llvm::errs() << "SALT server: " << *cwd << ": status " << status << "\n";
+    return status;
+}
+} // namespace
+
+std::string server_socket_path()
+{
+    if (const char *env = getenv("SALT_SERVER_SOCKET"))
+    {
+        return env;
+    }
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    if (dir == nullptr || *dir == '\0')
+    {
+        dir = getenv("TMPDIR");
+    }
+    if (dir == nullptr || *dir == '\0')
+    {
+        dir = "/tmp";
+    }
+    llvm::SmallString<256> path(dir);
+    llvm::sys::path::append(path, "salt-fm-" + std::to_string(getuid()) + "-" + SALT_VERSION_FULL + ".sock");
+    return path.str().str();
+}
+
+int run_server(const std::string &socket_path, request_handler handler)
+{
+    sockaddr_un addr;
+    if (!make_address(socket_path, addr))
+    {
+        llvm::errs() << "ERROR: invalid server socket path '" << socket_path << "'\n";
+        return 1;
+    }
+
+    int running = connect_to(socket_path);
+    if (running >= 0)
+    {
+        close(running);
+        llvm::errs() << "ERROR: a SALT server is already listening on " << socket_path << "\n";
+        return 1;
+    }
+    // Nobody answers, so any socket left there belongs to a server that died
+    unlink(socket_path.c_str());
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t old_mask = umask(077);
+    int bound = listen_fd < 0 ? -1 : bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    umask(old_mask);
+    if (bound != 0 || listen(listen_fd, 16) != 0)
+    {
+        llvm::errs() << "ERROR: cannot listen on " << socket_path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+
+    memcpy(serving_path, addr.sun_path, sizeof(serving_path));
+    signal(SIGINT, stop_serving);
+    signal(SIGTERM, stop_serving);
+    // A client that goes away must not take the server with it
+    signal(SIGPIPE, SIG_IGN);
+
+    llvm::errs() << "SALT server listening on " << socket_path << "\n";
+    while (true)
+    {
+        int conn = accept(listen_fd, nullptr, nullptr);
+        if (conn < 0)
+        {
+            continue;
+        }
+        if (!peer_is_self(conn))
+        {
+            llvm::errs() << "SALT server: refused a connection from another user\n";
+            close(conn);
+            continue;
+        }
+
+        // The first byte carries the client's stdout and stderr
+        char tag;
+        iovec iov = {&tag, 1};
+        alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int fds[2] = {-1, -1};
+        if (recvmsg(conn, &msg, 0) == 1)
+        {
+            for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+            {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+                    cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+                {
+                    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+                }
+            }
+        }
+        if (fds[0] >= 0 && fds[1] >= 0)
+        {
+            std::string request = read_all(conn);
+            int status = serve_request(request, fds[0], fds[1], handler);
+            write_all(conn, std::to_string(status) + "\n");
+        }
+        for (int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        close(conn);
+    }
+}
+
+bool forward_to_server(const std::string &socket_path, int argc, const char **argv, int &status)
+{
+    int conn = connect_to(socket_path);
+    if (conn < 0)
+    {
+        return false;
+    }
+    // Our stdout and stderr must only ever be handed to our own server
+    if (!peer_is_self(conn))
+    {
+        llvm::errs() << "WARNING: " << socket_path << " is served by another user, running locally\n";
+        close(conn);
+        return false;
+    }
+
+    llvm::SmallString<256> cwd;
+    llvm::sys::fs::current_path(cwd);
+    llvm::json::Array args;
+    for (int i = 0; i < argc; i++)
+    {
+        args.push_back(argv[i]);
+    }
+    llvm::json::Object env;
+    for (const char *name : forwarded_env)
+    {
+        if (const char *setting = getenv(name))
+        {
+            env[name] = setting;
+        }
+    }
+    std::string request;
+    llvm::raw_string_ostream(request)
+        << llvm::json::Value(llvm::json::Object{{"cwd", cwd.str()}, {"argv", std::move(args)}, {"env", std::move(env)}});
+
+    char tag = 'R';
+    iovec iov = {&tag, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    const int fds[2] = {STDOUT_FILENO, STDERR_FILENO};
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    fflush(stdout);
+    fflush(stderr);
+    if (sendmsg(conn, &msg, 0) != 1 || !write_all(conn, request))
+    {
+        close(conn);
+        return false;
+    }
+    shutdown(conn, SHUT_WR);
+
+    // No status means the server went away before finishing the request
+    std::string reply = read_all(conn);
+    close(conn);
+    llvm::StringRef trimmed = llvm::StringRef(reply).trim();
+    if (trimmed.empty() || trimmed.getAsInteger(10, status))
+    {
+        DPRINT("SALT server on %s did not answer, running locally\n", socket_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+header_cache::header_cache(std::vector<std::string> dirs) : dirs(std::move(dirs))
+{
+}
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> header_cache::file_system()
+{
+    return llvm::makeIntrusiveRefCnt<header_cache_fs>(
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem>(llvm::vfs::createPhysicalFileSystem()), *this);
+}
+
+bool header_cache::covers(llvm::StringRef path) const
+{
+    if (!llvm::sys::path::is_absolute(path))
+    {
+        return false;
+    }
+    for (const std::string &dir : dirs)
+    {
+        if (path.size() > dir.size() && path.starts_with(dir) && llvm::sys::path::is_separator(path[dir.size()]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void header_cache::revalidate()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    stale.clear();
+}
+
+llvm::ErrorOr<llvm::vfs::Status> header_cache::status(llvm::StringRef path, llvm::vfs::FileSystem &fs)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(path);
+        if (found != entries.end() && found->second.checked == generation)
+        {
+            if (found->second.error)
+            {
+                return found->second.error;
+            }
+            return found->second.status;
+        }
+    }
+
+    // Header search probes every include directory, so misses are kept too
+    llvm::ErrorOr<llvm::vfs::Status> result = fs.status(path);
+    std::lock_guard<std::mutex> lock(mutex);
+    entry &cached = entries[path];
+    if (cached.checked != generation)
+    {
+        // Contents read before the file changed (or went away) must be read again
+        if (cached.buffer && (!result || result->getLastModificationTime() != cached.status.getLastModificationTime() ||
+                              result->getSize() != cached.status.getSize()))
+        {
+            stale.push_back(std::move(cached.buffer));
+        }
+        if (result)
+        {
+            cached.error = std::error_code();
+            cached.status = *result;
+        }
+        else
+        {
+            cached.error = result.getError();
+        }
+        cached.checked = generation;
+    }
+    if (cached.error)
+    {
+        return cached.error;
+    }
+    return cached.status;
+}
+
+llvm::ErrorOr<llvm::vfs::Status> header_cache::read(llvm::StringRef path, llvm::vfs::FileSystem &fs,
+                                                    const llvm::MemoryBuffer *&buffer)
+{
+    llvm::ErrorOr<llvm::vfs::Status> checked = status(path, fs);
+    if (!checked)
+    {
+        return checked.getError();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = entries.find(path);
+        if (found != entries.end() && found->second.buffer)
+        {
+            buffer = found->second.buffer.get();
+            return found->second.status;
+        }
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> file = fs.openFileForRead(path);
+    if (!file)
+    {
+        return file.getError();
+    }
+    llvm::ErrorOr<llvm::vfs::Status> stat = (*file)->status();
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> contents = (*file)->getBuffer(path);
+    if (!stat || !contents)
+    {
+        buffer = nullptr;
+        return stat;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    entry &cached = entries[path];
+    if (!cached.buffer)
+    {
+        cached.error = std::error_code();
+        cached.status = *stat;
+        cached.buffer = std::move(*contents);
+    }
+    buffer = cached.buffer.get();
+    return cached.status;
+}
@@ -14,12 +14,22 @@
 #include "clang/Basic/SourceManager.h"
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Tooling/Core/Replacement.h"
 #include "clang/Tooling/CommonOptionsParser.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/xxhash.h"
 #include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <vector>
@@ -49,7 +59,8 @@ const std::string file_get_contents(FILE *fp)
     return std::string(buffer);
 }
 
-const char *loc_typ_strs[NUM_LOC_TYPES] = {"begin func", "return", "multiline return", "exit"};
+const char *loc_typ_strs[NUM_LOC_TYPES] = {"begin func", "end loop", "begin loop", "return",
+                                             "multiline return", "exit"};
 
 void makeFuncAndTimerNames(FunctionDecl *func, ASTContext *context, SourceManager &src_mgr, std::string &func_name,
                          std::string &timer_name);
@@ -65,16 +76,20 @@ bool comp_inst_loc(inst_loc *first, inst_loc *second)
     {
         return first->col < second->col;
     }
-    else
+    else if (first->kind != second->kind)
     { // SOME PEOPLE have functions that are just {} so we need to make sure begin comes before return
         return first->kind < second->kind;
     }
+    else
+    { // nested loops ending together: the inner one first
+        return first->func->loop_depth > second->func->loop_depth;
+    }
 }
 
 bool eq_inst_loc(inst_loc *first, inst_loc *second)
 {
     if (first->line == second->line && first->col == second->col && first->kind == second->kind &&
-        strcmp(first->func_name, second->func_name) == 0)
+        first->func->func_name == second->func->func_name)
     {
         return true;
     }
@@ -86,13 +101,13 @@ void dump_inst_loc(inst_loc *loc)
     DPRINT("\tLine:                 %d\n", loc->line);
     DPRINT("\tCol:                    %d\n", loc->col);
     DPRINT("\tKind:                 %s\n", loc_typ_strs[loc->kind]);
-    DPRINT("\tRet type:         %s\n", loc->return_type);
-    DPRINT("\tName:                 \"%s\"\n", loc->func_name);
-    DPRINT("\tTimer:                    %s\n", loc->full_timer_name);
-    DPRINT("\tHas args:         %s\n", loc->has_args ? "Yes" : "No");
-    DPRINT("\tIs ret ptr:     %s\n", loc->is_return_ptr ? "Yes" : "No");
-    DPRINT("\tNeeds move:     %s\n", loc->needs_move ? "Yes" : "No");
-    DPRINT("\tSkip:                 %s\n", loc->skip ? "Yes" : "No");
+    DPRINT("\tRet type:         %s\n", loc->func->return_type.str().c_str());
+    DPRINT("\tName:                 \"%s\"\n", loc->func->func_name.str().c_str());
+    DPRINT("\tTimer:                    %s\n", loc->func->full_timer_name.str().c_str());
+    DPRINT("\tHas args:         %s\n", loc->func->has_args ? "Yes" : "No");
+    DPRINT("\tIs ret ptr:     %s\n", loc->func->is_return_ptr ? "Yes" : "No");
+    DPRINT("\tNeeds move:     %s\n", loc->func->needs_move ? "Yes" : "No");
+    DPRINT("\tSkip:                 %s\n", loc->func->skip ? "Yes" : "No");
 }
 
 void dump_inst_loc(inst_loc *loc, int n)
@@ -110,14 +125,6 @@ void dump_inst_loc(inst_loc *loc, int n, bool (*filter)(inst_loc *))
     }
 }
 
-void dump_all_locs()
-{
-    for (int i = 0; i < inst_locs.size(); i++)
-    {
-        dump_inst_loc(inst_locs[i], i);
-    }
-}
-
 void dump_all_locs(std::vector<inst_loc *> locs)
 {
     for (int i = 0; i < locs.size(); i++)
@@ -126,14 +133,16 @@ void dump_all_locs(std::vector<inst_loc *> locs)
     }
 }
 
-void dump_all_locs(bool (*filter)(inst_loc *))
+void dump_all_locs(std::vector<inst_loc *> locs, bool (*filter)(inst_loc *))
 {
-    for (int i = 0; i < inst_locs.size(); i++)
+    for (int i = 0; i < locs.size(); i++)
     {
-        dump_inst_loc(inst_locs[i], i, filter);
+        dump_inst_loc(locs[i], i, filter);
     }
 }
 
+std::mutex output_mutex;
+
 std::string ReplacePhrase(std::string str, std::string phrase, std::string to_replace)
 {
     while (str.find(phrase) != std::string::npos)
@@ -143,177 +152,483 @@ std::string ReplacePhrase(std::string str, std::string phrase, std::string to_re
     return str;
 }
 
-void make_begin_func_code(inst_loc *loc, std::string &code, ryml::Tree yaml_tree, const bool use_cxx_api=false)
+namespace
 {
-    /* dump the location */
-    /* dump_inst_loc(loc); */
-    if (!loc->skip)
+const llvm::StringRef snippet_slot_names[NUM_SNIPPET_SLOTS] = {"full_timer_name", "timer_id", "static_handle",
+                                                                "timer_index", "timer_table"};
+
+// Compiles the lines under key, if the config has it. On a main() without
+// arguments TAU_INIT(&argc, &argv) cannot be called, so noargs (if given)
+// receives the same lines with that call replaced by a comment.
+bool load_snippet(const ryml::Tree &yaml_tree, const char *key, snippet &lines, snippet *noargs = nullptr)
+{
+    ryml::ConstNodeRef root = yaml_tree.crootref();
+    if (!root.is_map() || !root.has_child(ryml::to_csubstr(key)))
+    {
+        return false;
+    }
+    for (ryml::ConstNodeRef const &child : root[ryml::to_csubstr(key)].children())
     {
-        if (strcmp(loc->func_name, "main") == 0 )
+        std::string text(child.val().str, child.val().len);
+        lines.emplace_back(text, snippet_slot_names);
+        if (noargs != nullptr)
         {
-            // Insert on main function
-            for (ryml::NodeRef const& child : yaml_tree[use_cxx_api ? "main_insert_scope" : "main_insert"].children())
-            {
-                std::stringstream ss;
-                ss << child.val();
-                std::string updated_str;
-                updated_str  = ReplacePhrase(ss.str(), "${full_timer_name}", loc->full_timer_name);
-                /* handle the case where main does NOT have arguments */
-                if (!loc->has_args)
-                {
-                    updated_str = ReplacePhrase(updated_str, "    TAU_INIT(&argc, &argv);", "/* TAU_INIT() skipped, no arguments */");
-                }
-                code += updated_str + "\n";
-            }
+            text = ReplacePhrase(text, "    TAU_INIT(&argc, &argv);", "/* TAU_INIT() skipped, no arguments */");
+            noargs->emplace_back(text, snippet_slot_names);
         }
-        else
+    }
+    return true;
+}
+
+// Reads and compiles configfile into config; returns false if it cannot be read
+bool load_inst_config(inst_config &config)
+{
+    if (FILE *config_file = fopen(configfile.c_str(), "r"))
+    {
+        fclose(config_file);
+    }
+    else
+    {
+        llvm::outs() << "No config file found\n";
+        return false;
+    }
+    std::ifstream inputStream{configfile.c_str()};
+    if (!inputStream)
+    {
+        llvm::errs() << "ERROR: Could not open configuration file " << configfile.c_str() << "\n";
+        return false;
+    }
+    std::stringstream configStream;
+    configStream << inputStream.rdbuf();
+    ryml::Tree yaml_tree = ryml::parse_in_arena(ryml::to_csubstr(configStream.str()));
+
+    ryml::ConstNodeRef root = yaml_tree.crootref();
+    if (root.is_map() && root.has_child("instrumentation"))
+    {
+        ryml::csubstr instrumentation = root["instrumentation"].val();
+        config.instrumentation.assign(instrumentation.str, instrumentation.len);
+    }
+    if (root.is_map() && root.has_child("include"))
+    {
+        for (ryml::ConstNodeRef const &child : root["include"].children())
         {
-            // Insert on function begin insert
-            for (ryml::NodeRef const& child : yaml_tree[use_cxx_api ? "function_begin_insert_scope" : "function_begin_insert"].children())
-            {
-                std::stringstream ss;
-                ss << child.val();
-                std::string updated_str;
-                updated_str  = ReplacePhrase(ss.str(), "${full_timer_name}", loc->full_timer_name);
-                code += updated_str + "\n";
-            }
+            config.includes.emplace_back(child.val().str, child.val().len);
         }
     }
+    load_snippet(yaml_tree, "main_insert", config.main_insert, &config.main_insert_noargs);
+    config.has_main_insert_scope =
+        load_snippet(yaml_tree, "main_insert_scope", config.main_insert_scope, &config.main_insert_scope_noargs);
+    load_snippet(yaml_tree, "function_begin_insert", config.function_begin_insert);
+    config.has_function_begin_insert_scope =
+        load_snippet(yaml_tree, "function_begin_insert_scope", config.function_begin_insert_scope);
+    load_snippet(yaml_tree, "function_end_insert", config.function_end_insert);
+    if (!load_snippet(yaml_tree, "loop_begin_insert", config.loop_begin_insert))
+    {
+        config.loop_begin_insert = config.function_begin_insert;
+    }
+    if (!load_snippet(yaml_tree, "loop_begin_insert_scope", config.loop_begin_insert_scope))
+    {
+        config.loop_begin_insert_scope = config.function_begin_insert_scope;
+    }
+    if (!load_snippet(yaml_tree, "loop_end_insert", config.loop_end_insert))
+    {
+        config.loop_end_insert = config.function_end_insert;
+    }
+    return true;
 }
 
-// returns true if we can/should skip putting the line after this into the inst file
-void make_end_func_code(inst_loc *loc, std::string &code, std::string &line, ryml::Tree yaml_tree)
+// Appends every line of lines for func to code, each between before and after
+void expand_snippet(const snippet &lines, const func_info *func, std::string &code, const char *before,
+                    const char *after)
 {
-    if (line.find("return", loc->col) == std::string::npos)
+    // With --salt_timer_ids the long name stays in the timer table
+    const llvm::StringRef name = func->timer_key.empty() ? func->full_timer_name : func->timer_key;
+    const llvm::StringRef values[NUM_SNIPPET_SLOTS] = {name, func->timer_id, func->static_handle, func->timer_index,
+                                                       func->timer_table};
+    for (const salt::SnippetTemplate &line : lines)
     {
-        // don't put anything in for non-void functions missing explicit return
-        // if we have int main() with no explicit return, use -optDisable hack
-        // -glares at cmake-
-        if (std::string(loc->return_type).find("void") == std::string::npos)
+        code += before;
+        line.expand(code, values);
+        code += after;
+    }
+}
+
+// Written at the top of every output with --salt_throttle: the state of a
+// guard, kept in a static per function, and what its end snippet runs. The
+// counters are not atomic; threads can lose updates, which only delays
+// turning a probe off. Strict ISO C modes hide clock_gettime(), so there the
+// guard falls back to the processor time of clock().
+const char *const throttle_prelude = R"(#ifndef SALT_THROTTLE_GUARD
+#define SALT_THROTTLE_GUARD
+#include <time.h>
+typedef struct salt_throttle_t
+{
+    unsigned long long calls;
+    unsigned long long nsec;
+    int off;
+} salt_throttle_t;
+/* Never 0, which marks a call whose probe was skipped */
+static inline unsigned long long salt_throttle_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec) | 1;
+#else
+    return ((unsigned long long)clock() * (1000000000ULL / CLOCKS_PER_SEC)) | 1;
+#endif
+}
+static inline void salt_throttle_stop(salt_throttle_t *t, unsigned long long start, unsigned long long calls,
+                                      unsigned long long nsec)
+{
+    t->nsec += salt_throttle_now() - start;
+    if (++t->calls >= calls && t->nsec < t->calls * nsec)
+    {
+        t->off = 1;
+    }
+}
+#endif /* SALT_THROTTLE_GUARD */
+)";
+
+// Written at the top of every output with --salt_enable_table: salt_enable.h
+// without its license, which CMake copies into salt_enable_prelude.inc
+const char *const enable_prelude =
+#include "salt_enable_prelude.inc"
+    ;
+
+// Appends str to code as a C string literal
+void append_c_string(llvm::StringRef str, std::string &code)
+{
+    code += '"';
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
         {
-            return;
+            code += '\\';
         }
-        else
+        code += c;
+    }
+    code += '"';
+}
+
+// The --salt_enable_table of an output: all bits set, the names to match
+// by index, and the code that registers them with salt-enable
+std::string make_enable_table(const std::vector<func_info *> &timers)
+{
+    const std::string table = timers.front()->timer_table.str();
+    const std::string count = std::to_string(timers.size());
+    std::string code = "static unsigned char " + table + "_enable_bits[" + std::to_string((timers.size() + 7) / 8) +
+                       "] = {";
+    for (size_t byte = 0; byte < (timers.size() + 7) / 8; byte++)
+    {
+        code += byte == 0 ? "0xff" : ", 0xff";
+    }
+    code += "};\nstatic const char *const " + table + "_enable_names[" + count + "] = {\n";
+    for (const func_info *func : timers)
+    {
+        code += "    ";
+        append_c_string(func->full_timer_name, code);
+        code += ",\n";
+    }
+    code += "};\n";
+    code += "static salt_enable_table " + table + "_enable = {" + table + "_enable_bits, " + table +
+            "_enable_names, " + count + ", 0};\n";
+    // Registered before main() by a constructor function, which GCC-compatible
+    // compilers provide, or in C++ by the initializer of a static
+    code += "#if defined(__GNUC__)\n";
+    code += "__attribute__((constructor)) static void " + table + "_enable_register(void)\n";
+    code += "{\n    salt_enable_register(&" + table + "_enable);\n}\n";
+    code += "#elif defined(__cplusplus)\n";
+    code += "static const int " + table + "_enable_registered = (salt_enable_register(&" + table + "_enable), 0);\n";
+    code += "#else\n";
+    code += "#error \"--salt_enable_table needs __attribute__((constructor)) in C: use GCC, Clang or a compatible "
+            "compiler\"\n";
+    code += "#endif\n";
+    return code;
+}
+
+// The --salt_enable_table test of func's bit, latched on entry so that a
+// switch during a call cannot leave its begin probe without its end probe
+std::string enable_bit(const func_info *func)
+{
+    unsigned index = 0;
+    func->timer_index.getAsInteger(10, index);
+    return "(SALT_ENABLE_LOAD(" + func->timer_table.str() + "_enable_bits[" + std::to_string(index / 8) + "]) & " +
+           std::to_string(1u << (index % 8)) + ") != 0";
+}
+
+// The function the timed loop func is nested in, or func itself
+const func_info *routine_of(const func_info *func)
+{
+    while (func->parent != nullptr)
+    {
+        func = func->parent;
+    }
+    return func;
+}
+
+// Appended to the names of the guard variables and labels in func's probes:
+// a loop's share the function with its function's, so they get its index
+std::string guard_suffix(const func_info *func)
+{
+    return func->parent == nullptr ? "" : "_" + func->timer_index.str();
+}
+
+// With --salt_groups, opens the #if of func's group (for a loop, its
+// function's) around the probe code appended to code next, on a line of its own
+void open_group(const func_info *func, std::string &code)
+{
+    if (!groups)
+    {
+        return;
+    }
+    if (!code.empty() && code.back() != '\n')
+    {
+        code += "\n";
+    }
+    code += "#if ";
+    code += salt::groupMacro(routine_of(func)->group);
+    code += "\n";
+}
+
+// Closes the #if of open_group()
+void close_group(std::string &code)
+{
+    if (!groups)
+    {
+        return;
+    }
+    if (!code.empty() && code.back() != '\n')
+    {
+        code += "\n";
+    }
+    code += "#endif\n";
+}
+
+// Appends the begin snippet lines of func to code, behind the
+// --salt_enable_table test and the --salt_throttle guard if they are on. The
+// guards jump over the snippet rather than wrapping it in a block, so what
+// the snippet declares stays in scope for the end snippet; in C++ that
+// requires begin snippets to declare only statics.
+void expand_begin_snippet(const snippet &lines, const func_info *func, std::string &code)
+{
+    open_group(func, code);
+    if (!throttle && !enable_table)
+    {
+        expand_snippet(lines, func, code, "", "\n");
+        close_group(code);
+        return;
+    }
+    std::string state = func->timer_id.str() + "_throttle";
+    std::string suffix = guard_suffix(func);
+    if (throttle)
+    {
+        code += "static salt_throttle_t " + state + ";\n";
+        code += "unsigned long long salt_throttle_start" + suffix + " = 0;\n";
+    }
+    if (enable_table)
+    {
+        code += "int salt_enable_on" + suffix + " = " + enable_bit(func) + ";\n";
+        code += "if (!salt_enable_on" + suffix + ") goto salt_enable_skip" + suffix + ";\n";
+    }
+    if (throttle)
+    {
+        code += "if (" + state + ".off) goto salt_throttle_skip" + suffix + ";\n";
+    }
+    expand_snippet(lines, func, code, "", "\n");
+    if (throttle)
+    {
+        code += "salt_throttle_start" + suffix + " = salt_throttle_now();\n";
+        code += "salt_throttle_skip" + suffix + ":;\n";
+    }
+    if (enable_table)
+    {
+        code += "salt_enable_skip" + suffix + ":;\n";
+    }
+    close_group(code);
+}
+
+// Appends the end snippet of func (a function or a timed loop) to code, which
+// with --salt_enable_table and --salt_throttle runs only if the begin snippet
+// did, after the guard counted the call
+void expand_end_snippet(const inst_config &config, const func_info *func, std::string &code, const char *before,
+                        const char *after)
+{
+    std::string suffix = guard_suffix(func);
+    open_group(func, code);
+    if (enable_table)
+    {
+        code += before;
+        code += "if (salt_enable_on" + suffix + ") {";
+        code += after;
+    }
+    if (throttle)
+    {
+        unsigned long long nsec =
+            throttle_usec > 0 ? static_cast<unsigned long long>(throttle_usec * 1000 + 0.5) : 0;
+        code += before;
+        code += "if (salt_throttle_start" + suffix + ") { salt_throttle_stop(&" + func->timer_id.str() +
+                "_throttle, salt_throttle_start" + suffix + ", " + std::to_string(throttle_calls) + "ULL, " +
+                std::to_string(nsec) + "ULL);";
+        code += after;
+    }
+    expand_snippet(func->parent != nullptr ? config.loop_end_insert : config.function_end_insert, func, code, before,
+                   after);
+    if (throttle)
+    {
+        code += before;
+        code += "}";
+        code += after;
+    }
+    if (enable_table)
+    {
+        code += before;
+        code += "}";
+        code += after;
+    }
+    close_group(code);
+}
+} // namespace
+
+std::shared_ptr<const inst_config> get_inst_config()
+{
+    // Shared by every instrumentor, including those on -j worker threads. A
+    // server keeps it across requests until they name another config or the
+    // file is modified.
+    static std::mutex config_mutex;
+    static std::shared_ptr<const inst_config> config;
+    static std::string config_path;
+    static llvm::sys::TimePoint<> config_mtime;
+
+    llvm::sys::fs::file_status status;
+    llvm::sys::TimePoint<> mtime;
+    if (!llvm::sys::fs::status(configfile, status))
+    {
+        mtime = status.getLastModificationTime();
+    }
+
+    std::lock_guard<std::mutex> lock(config_mutex);
+    if (!config || config_path != configfile || config_mtime != mtime)
+    {
+        llvm::TimeTraceScope trace_scope("ReadConfig", configfile.getValue());
+        auto loaded = std::make_shared<inst_config>();
+        if (!load_inst_config(*loaded))
         {
-            // if it is void, put in stop just in case
-            if (!loc->skip)
-            {
-                // Insert on function begin insert
-                for (ryml::NodeRef const& child : yaml_tree["function_end_insert"].children())
-                {
-                    std::stringstream ss;
-                    ss << child.val();
-                    std::string updated_str;
-                    updated_str  = ReplacePhrase(ss.str(), "${full_timer_name}", loc->full_timer_name);
-                    code += "\t" + updated_str + "\n";
-                }
-            }
-            else
-            {
-                code = "";
-            }
-            return;
+            return nullptr;
         }
+        config = std::move(loaded);
+        config_path = configfile;
+        config_mtime = mtime;
     }
-    // types are harder, need to pull the arg to return before the stop in case it does things
-    else
+    return config;
+}
+
+void make_begin_func_code(inst_loc *loc, std::string &code, const inst_config &config, const bool use_cxx_api=false)
+{
+    /* dump the location */
+    /* dump_inst_loc(loc); */
+    if (!loc->func->skip)
     {
-        if (!loc->skip)
+        if (loc->func->func_name == "main")
         {
-            std::string temp = line;
-            temp.erase(std::remove_if(temp.begin(), temp.end(), isspace), temp.end());
-            if (temp.find("return;") != std::string::npos)
-            {
-                // also throw in brackets in case SOMEONE didn't put brackets around their if
-                // Insert on function begin insert
-                for (ryml::NodeRef const& child : yaml_tree["function_end_insert"].children())
-                {
-                    std::stringstream ss;
-                    ss << child.val();
-                    std::string updated_str;
-                    updated_str  = ReplacePhrase(ss.str(), "${full_timer_name}", loc->full_timer_name);
-                    code += "\t{" + updated_str + " ";
-                }
-                code += "return;}\n";
-                return;
-            }
-            else
-            {
-                // special case void*
-                if (std::string(loc->return_type).find("void") != std::string::npos && !loc->is_return_ptr)
-                {
-                    code += "\t{ ";
-                    int first_pos = line.find("return") + 6;
-                    int last_pos = line.find(";", first_pos);
-                    code += line.substr(first_pos, last_pos - first_pos + 1);
-
-                    // Insert on function begin insert
-                    for (ryml::NodeRef const& child : yaml_tree["function_end_insert"].children())
-                    {
-                        std::stringstream ss;
-                        ss << child.val();
-                        std::string updated_str;
-                        updated_str  = ReplacePhrase(ss.str(), "${full_timer_name}", loc->full_timer_name);
-                        code += " " + updated_str + " ";
-                    }
-                    code += "return; }\n";
-                }
-                // special case if we need to throw in a std::move because of copy assign shenanigans
-                else if (loc->needs_move)
-                {
-                    code += "\t{ ";
-                    code += loc->return_type;
-                    code += " inst_ret_val = std::move(";
-                    int first_pos = line.find("return") + 6;
-                    int last_pos = line.find(";", first_pos);
-                    // no +1, don't want semicolon
-                    code += line.substr(first_pos, last_pos - first_pos);
-                    code += "); ";
-
-                     // Insert on function begin insert
-                    for (ryml::NodeRef const& child : yaml_tree["function_end_insert"].children())
-                    {
-                        std::stringstream ss;
-                        ss << child.val();
-                        std::string updated_str;
-                        updated_str  = ReplacePhrase(ss.str(), "${full_timer_name}", loc->full_timer_name);
-                        code += " " + updated_str + " ";
-                    }
-                    code += "return inst_ret_val; }\n";
-                }
-                // general case for typed returns
-                else
-                {
-                    code += "\t{ ";
-                    code += loc->return_type;
-                    code += " inst_ret_val = ";
-                    int first_pos = line.find("return") + 6;
-                    int last_pos = line.find(";", first_pos);
-                    // +1 to catch the semicolon too
-                    code += line.substr(first_pos, last_pos - first_pos + 1);
-
-                     // Insert on function begin insert
-                    for (ryml::NodeRef const& child : yaml_tree["function_end_insert"].children())
-                    {
-                        std::stringstream ss;
-                        ss << child.val();
-                        std::string updated_str;
-                        updated_str  = ReplacePhrase(ss.str(), "${full_timer_name}", loc->full_timer_name);
-                        code += " " + updated_str + " ";
-                    }
-                    code += "return inst_ret_val; }\n";
-                }
-                return;
-            }
+            // Insert on main function, handling the case where main does NOT have arguments
+            const snippet &lines = use_cxx_api ? (loc->func->has_args ? config.main_insert_scope
+                                                                      : config.main_insert_scope_noargs)
+                                               : (loc->func->has_args ? config.main_insert : config.main_insert_noargs);
+            expand_begin_snippet(lines, loc->func, code);
         }
         else
         {
-            code = line;
-            code += "\n";
+            // Insert on function begin insert
+            expand_begin_snippet(use_cxx_api ? config.function_begin_insert_scope : config.function_begin_insert,
+                                 loc->func, code);
         }
     }
 }
 
+// Opens the block a timed loop is wrapped in, so that its end snippet runs
+// however the loop finishes except by a return or goto, and starts its timer
+void make_begin_loop_code(inst_loc *loc, std::string &code, const inst_config &config, const bool use_cxx_api)
+{
+    code += "{\n";
+    expand_begin_snippet(use_cxx_api ? config.loop_begin_insert_scope : config.loop_begin_insert, loc->func, code);
+}
+
+// Stops the timer of a loop and closes its block, where a scoped timer stops
+void make_end_loop_code(inst_loc *loc, std::string &code, const inst_config &config, const bool use_cxx_api)
+{
+    if (!use_cxx_api)
+    {
+        expand_end_snippet(config, loc->func, code, "", "\n");
+    }
+    code += "}\n";
+}
+
+// Appends the end snippets run by a return: those of the timed loops it
+// leaves, innermost first, and its function's
+void expand_return_end_snippets(const inst_config &config, const inst_loc *loc, std::string &code,
+                                const char *before, const char *after)
+{
+    for (const func_info *loop = loc->loop; loop != nullptr && loop != loc->func; loop = loop->parent)
+    {
+        expand_end_snippet(config, loop, code, before, after);
+    }
+    expand_end_snippet(config, loc->func, code, before, after);
+}
+
+// Appends the code replacing a return statement of loc's function, whose
+// returned value (if any) is value, to code
+void make_return_code(inst_loc *loc, std::string &code, llvm::StringRef value, const inst_config &config)
+{
+    if (!loc->has_value)
+    {
+        // also throw in brackets in case SOMEONE didn't put brackets around their if
+        // Insert on function end insert
+        code += "\t{";
+        expand_return_end_snippets(config, loc, code, "", " ");
+        code += "return;}\n";
+    }
+    // types are harder, need to pull the arg to return before the stop in case it does things
+    // special case void*
+    else if (loc->func->return_type.contains("void") && !loc->func->is_return_ptr)
+    {
+        code += "\t{ ";
+        code += value;
+        code += ";";
+
+        // Insert on function end insert
+        expand_return_end_snippets(config, loc, code, " ", " ");
+        code += "return; }\n";
+    }
+    // special case if we need to throw in a std::move because of copy assign shenanigans
+    else if (loc->func->needs_move)
+    {
+        code += "\t{ ";
+        code += loc->func->return_type;
+        code += " inst_ret_val = std::move(";
+        code += value;
+        code += "); ";
+
+        // Insert on function end insert
+        expand_return_end_snippets(config, loc, code, " ", " ");
+        code += "return inst_ret_val; }\n";
+    }
+    // general case for typed returns
+    else
+    {
+        code += "\t{ ";
+        code += loc->func->return_type;
+        code += " inst_ret_val = ";
+        code += value;
+        code += ";";
+
+        // Insert on function end insert
+        expand_return_end_snippets(config, loc, code, " ", " ");
+        code += "return inst_ret_val; }\n";
+    }
+}
+
+
 // https://stackoverflow.com/questions/2896600/how-to-replace-all-occurrences-of-a-character-in-string
 std::string ReplaceAll(std::string str, const std::string &from, const std::string &to)
 {
@@ -348,83 +663,29 @@ inline std::string &trim(std::string &s, const char *t = " \t\n\r\f\v")
     return ltrim(rtrim(s, t), t);
 }
 
-// first arg is from list (might have wildcard), second string is ours
-bool matchName(std::string &regex, std::string &match)
-{
-    /* Use '#' as the wildcard kleene star operator character */
-    regex = ReplaceAll(regex, std::string("*"), std::string("\\*"));
-    regex = ReplaceAll(regex, std::string("#"), std::string(".*"));
-
-    return std::regex_match(trim(match), std::regex(trim(regex), std::regex_constants::grep));
-}
-
-// returns true if loc matches something in list
-bool check_loc_against_list(std::list<std::string> list, inst_loc *loc)
+// returns true if function matches something in list
+bool check_func_against_list(const salt::SelectMatcher &list, const func_info *func)
 {
-    // printf("checking loc against list\n");
-    std::string timer_name = std::string(loc->full_timer_name).substr(0, std::string(loc->full_timer_name).find("["));
-    for (std::string item : list)
+    if (list.empty())
     {
-        if (matchName(item, timer_name))
-        {
-            DPRINT("found match for: %s\n", loc->full_timer_name);
-            DPRINT("%s\n", item.c_str());
-            return true;
-        }
+        return false;
     }
-    return false;
-}
-
-// returns true if function matches something in list
-bool check_func_against_list(std::list<std::string> list, FunctionDecl *func, ASTContext *context,
-                             SourceManager &src_mgr)
-{
-    std::string func_name;
-    std::string timer_name;
     // printf("checking function against list\n");
-    makeFuncAndTimerNames(func, context, src_mgr, func_name, timer_name);
-    timer_name = timer_name.substr(0, timer_name.find("["));
-    // printf("timer_name %s\n", timer_name.c_str());
-    for (std::string item : list)
+    llvm::StringRef timer_name = func->full_timer_name.split('[').first;
+    if (list.matches(timer_name))
     {
-        // printf("item %s\n", item.c_str());
-        if (matchName(item, timer_name))
-        {
-            DPRINT("found match for: %s\n", timer_name.c_str());
-            DPRINT("%s\n", item.c_str());
-            return true;
-        }
+        DPRINT("found match for: %s\n", func->full_timer_name.str().c_str());
+        return true;
     }
     return false;
 }
 
-bool matchFileName(std::string &regex, std::string &match)
-{
-    // TODO: if no "/", just match on filename (slice match)
-    regex = ReplaceAll(regex, std::string("*"), std::string(".*"));
-    if (regex.find("/") == std::string::npos)
-    {
-        // if no path is specified, match any path OR the original filename
-        regex = ReplaceAll(std::string("(.*/x|x)"), std::string("x"), regex);
-    }
-    // printf("string    %s\n", match.c_str());
-    // printf("regex     %s\n", regex.c_str());
-    // printf("match?    %s\n", std::regex_match(trim(match), std::regex(trim(regex), std::regex_constants::egrep)) ?
-    // "Yes": "No");
-
-    return std::regex_match(trim(match), std::regex(trim(regex), std::regex_constants::egrep));
-}
-
-
-bool check_file_against_list(std::list<std::string> list, std::string fname)
+bool check_file_against_list(const salt::SelectMatcher &list, std::string fname)
 {
-    for (std::string item : list)
+    if (list.matches(fname))
     {
-        if (matchFileName(item, fname))
-        {
-            DPRINT("found match for: %s\n", fname.c_str());
-            return true;
-        }
+        DPRINT("found match for: %s\n", fname.c_str());
+        return true;
     }
     return false;
 }
@@ -491,15 +752,155 @@ void makeFuncAndTimerNames(FunctionDecl *func, ASTContext *context, SourceManage
                std::to_string(start_col) + "}-{" + std::to_string(end_line) + "," + std::to_string(end_col) + "}]";
 }
 
+// Hashing the timer name keeps the identifier stable across runs and
+// translation units, so a cached output never changes its statics
+static std::string make_timer_id(const std::string &timer_name)
+{
+    return "salt_timer_" + llvm::utohexstr(llvm::xxh3_64bits(llvm::arrayRefFromStringRef(timer_name)),
+                                           /*LowerCase=*/true);
+}
+
+func_info *instrumentor::get_func_info(FunctionDecl *func, ASTContext *context, SourceManager &src_mgr)
+{
+    const FunctionDecl *definition = nullptr;
+    func->getBody(definition);
+    if (definition != nullptr)
+    {
+        func = const_cast<FunctionDecl *>(definition);
+    }
+    func_info *&slot = func_table[func];
+    if (slot != nullptr)
+    {
+        return slot;
+    }
+
+    if (!arena)
+    {
+        arena = std::make_unique<loc_arena>();
+    }
+    func_info *info = new (arena->alloc.Allocate<func_info>()) func_info;
+    funcs.push_back(info);
+
+    std::string func_name;
+    std::string timer_name;
+    makeFuncAndTimerNames(func, context, src_mgr, func_name, timer_name);
+    info->func_name = arena->strings.save(func_name);
+    info->full_timer_name = arena->strings.save(timer_name);
+    std::string timer_id = make_timer_id(timer_name);
+    info->timer_id = arena->strings.save(timer_id);
+    info->static_handle = arena->strings.save(timer_id + "_handle");
+
+    std::string ret_name = func->getReturnType().getAsString();
+    if (func->getReturnType().getTypePtr()->isBooleanType() && ret_name.find("_Bool") != std::string::npos)
+    {
+        ret_name.replace(ret_name.find("_Bool"), 5, "bool");
+    }
+    if (ret_name.substr(0, 5).find("class") != std::string::npos)
+    {
+        ret_name = ret_name.substr(6); // if it starts with "class", chop that off
+    }
+    if (ret_name.substr(0, 11).find("const class") != std::string::npos)
+    {
+        ret_name = ret_name.erase(6, 6); // if it starts with "class", chop that off
+    }
+    info->return_type = arena->strings.save(ret_name);
+
+    // The file the body's braces are in, where its code gets inserted, resolved
+    // so that instrument() can match it against the path it was given
+    info->fid = src_mgr.getFileID(src_mgr.getFileLoc(func->getBody()->getBeginLoc()));
+    info->file = real_path_of(info->fid, src_mgr);
+
+    if (func->getReturnType()->isClassType())
+    {
+        CXXRecordDecl *decl = func->getReturnType()->getAsCXXRecordDecl();
+        if (!(decl->hasSimpleCopyAssignment() || decl->hasTrivialCopyAssignment()))
+        {
+            info->needs_move = true;
+        }
+    }
+    info->has_args = func->getNumParams() > 0;
+    info->is_return_ptr = func->getReturnType()->isPointerType();
+
+    slot = info;
+    return info;
+}
+
+func_info *instrumentor::make_loop_info(func_info *parent, const std::string &timer_name)
+{
+    func_info *info = new (arena->alloc.Allocate<func_info>()) func_info;
+    // The name also tells the loops of a function apart in eq_inst_loc
+    info->full_timer_name = arena->strings.save(timer_name);
+    info->func_name = info->full_timer_name;
+    std::string timer_id = make_timer_id(timer_name);
+    info->timer_id = arena->strings.save(timer_id);
+    info->static_handle = arena->strings.save(timer_id + "_handle");
+    info->return_type = parent->return_type;
+    info->file = parent->file;
+    info->fid = parent->fid;
+    info->parent = parent;
+    info->loop_depth = parent->loop_depth + 1;
+    return info;
+}
+
+llvm::StringRef instrumentor::real_path_of(FileID fid, SourceManager &src_mgr)
+{
+    OptionalFileEntryRef entry = src_mgr.getFileEntryRefForID(fid);
+    if (!entry)
+    {
+        return "";
+    }
+    llvm::StringRef name = entry->getFileEntry().tryGetRealPathName();
+    if (name.empty())
+    {
+        name = entry->getName();
+    }
+    // Resolved once per file name
+    auto cached = real_paths.try_emplace(name);
+    if (cached.second)
+    {
+        if (!arena)
+        {
+            arena = std::make_unique<loc_arena>();
+        }
+        llvm::SmallString<256> real_name;
+        if (llvm::sys::fs::real_path(name, real_name))
+        {
+            real_name = name;
+        }
+        cached.first->second = arena->strings.save(real_name.str());
+    }
+    return cached.first->second;
+}
+
+void instrumentor::save_main_buffer(SourceManager &src_mgr)
+{
+    FileID main_file = src_mgr.getMainFileID();
+    llvm::StringRef file = real_path_of(main_file, src_mgr);
+    if (!file.empty() && !file_buffers.count(file))
+    {
+        file_buffers[file] = src_mgr.getBufferData(main_file).str();
+    }
+}
+
+// A loop timed in the function being visited, and the bytes it spans in its file
+typedef struct timed_loop {
+    unsigned begin;
+    unsigned end;
+    func_info *info;
+} timed_loop;
+
 class FindReturnVisitor : public RecursiveASTVisitor<FindReturnVisitor>
 {
     ASTContext *context;
     SourceManager &src_mgr;
-    FunctionDecl *encl_function;
+    instrumentor &inst;
+    func_info *encl_function;
+    std::vector<timed_loop> loops;
     std::vector<SourceRange> lambda_locs;
 
   public:
-    explicit FindReturnVisitor(ASTContext *context, SourceManager &SM) : context(context), src_mgr(SM)
+    explicit FindReturnVisitor(ASTContext *context, SourceManager &SM, instrumentor &inst)
+        : context(context), src_mgr(SM), inst(inst)
     {
     }
 
@@ -528,8 +929,21 @@ class FindReturnVisitor : public RecursiveASTVisitor<FindReturnVisitor>
     {
         SourceRange range = retstmt->getSourceRange();
 
+        // The statement is replaced up to its ';', so it has to be written out in
+        // the function's file; a return spelled by a macro is left alone
+        if (range.getBegin().isMacroID() || src_mgr.getFileID(range.getBegin()) != encl_function->fid)
+        {
+            return;
+        }
+        SourceLocation after_semi =
+            Lexer::findLocationAfterToken(range.getEnd(), tok::semi, src_mgr, context->getLangOpts(), false);
+        if (after_semi.isInvalid() || src_mgr.getFileID(after_semi) != encl_function->fid)
+        {
+            return;
+        }
+
         FullSourceLoc start_loc = context->getFullLoc(range.getBegin());
-        FullSourceLoc end_loc = context->getFullLoc(range.getEnd());
+        FullSourceLoc end_loc = context->getFullLoc(after_semi);
 
         unsigned int start_line = start_loc.getSpellingLineNumber();
         unsigned int start_col = start_loc.getSpellingColumnNumber();
@@ -537,71 +951,247 @@ class FindReturnVisitor : public RecursiveASTVisitor<FindReturnVisitor>
         // unused
         // unsigned int end_col = end_loc.getSpellingColumnNumber();
 
-        std::string func_name;
-        std::string timer_name;
-        makeFuncAndTimerNames(encl_function, context, src_mgr, func_name, timer_name);
+        inst_loc *ret = inst.make_inst_loc(encl_function);
+        ret->line = start_line;
+        ret->col = start_col - 1;
+        ret->kind = start_line == end_line ? RETURN_FUNC : MULTILINE_RETURN_FUNC;
+        ret->offset = src_mgr.getFileOffset(range.getBegin());
+        ret->end_offset = src_mgr.getFileOffset(after_semi);
+        ret->has_value = retstmt->getRetValue() != nullptr;
+        for (const timed_loop &loop : loops)
+        {
+            if (loop.begin <= ret->offset && ret->offset < loop.end &&
+                (ret->loop == nullptr || loop.info->loop_depth > ret->loop->loop_depth))
+            {
+                ret->loop = loop.info;
+            }
+        }
+
+        // llvm::outs() << "\tFound return at " << start_line << ":" << start_col << "\n";
+    }
+
+    friend class FindFunctionVisitor;
+};
+
+// Measures a function body for the --salt_min_* thresholds. Lambdas and local
+// classes count toward the function whose body holds them.
+class FunctionSizeVisitor : public RecursiveASTVisitor<FunctionSizeVisitor>
+{
+  public:
+    salt::FunctionSize size;
+
+    bool VisitStmt(Stmt *stmt)
+    {
+        size.nodes++;
+        if (isa<ForStmt, WhileStmt, DoStmt, CXXForRangeStmt>(stmt))
+        {
+            size.hasLoop = true;
+        }
+        else if (isa<CallExpr>(stmt))
+        {
+            size.hasCall = true;
+        }
+        return true;
+    }
+
+    bool VisitDecl(Decl *decl)
+    {
+        size.nodes++;
+        return true;
+    }
+
+    // A statement is any entry of a block, or the unbraced body of a branch or loop
+    bool VisitCompoundStmt(CompoundStmt *block)
+    {
+        for (Stmt *stmt : block->body())
+        {
+            if (!isa<NullStmt>(stmt))
+            {
+                size.statements++;
+            }
+        }
+        return true;
+    }
+
+    bool VisitIfStmt(IfStmt *stmt)
+    {
+        countBody(stmt->getThen());
+        countBody(stmt->getElse());
+        return true;
+    }
+
+    bool VisitForStmt(ForStmt *stmt)
+    {
+        countBody(stmt->getBody());
+        return true;
+    }
+
+    bool VisitWhileStmt(WhileStmt *stmt)
+    {
+        countBody(stmt->getBody());
+        return true;
+    }
+
+    bool VisitDoStmt(DoStmt *stmt)
+    {
+        countBody(stmt->getBody());
+        return true;
+    }
+
+    bool VisitCXXForRangeStmt(CXXForRangeStmt *stmt)
+    {
+        countBody(stmt->getBody());
+        return true;
+    }
+
+  private:
+    void countBody(const Stmt *body)
+    {
+        if (body != nullptr && !isa<CompoundStmt, NullStmt>(body))
+        {
+            size.statements++;
+        }
+    }
+};
+
+// Finds the loops of a function body to time for the select file's "loops"
+// commands: the for, while, do and range-based for loops nested at most level
+// deep. Lambdas and local classes are left out, since their returns are not
+// the function's.
+class FindLoopVisitor : public RecursiveASTVisitor<FindLoopVisitor>
+{
+    ASTContext *context;
+    SourceManager &src_mgr;
+    instrumentor &inst;
+    // The innermost timed loop around the one visited, or the function
+    func_info *parent;
+    unsigned level;
+    unsigned depth = 0;
+
+  public:
+    std::vector<timed_loop> loops;
+
+    explicit FindLoopVisitor(ASTContext *context, SourceManager &SM, instrumentor &inst, func_info *function,
+                             unsigned level)
+        : context(context), src_mgr(SM), inst(inst), parent(function), level(level)
+    {
+    }
+
+    bool TraverseForStmt(ForStmt *loop)
+    {
+        return traverseLoop(loop, [&] { return RecursiveASTVisitor<FindLoopVisitor>::TraverseForStmt(loop); });
+    }
+
+    bool TraverseWhileStmt(WhileStmt *loop)
+    {
+        return traverseLoop(loop, [&] { return RecursiveASTVisitor<FindLoopVisitor>::TraverseWhileStmt(loop); });
+    }
+
+    bool TraverseDoStmt(DoStmt *loop)
+    {
+        return traverseLoop(loop, [&] { return RecursiveASTVisitor<FindLoopVisitor>::TraverseDoStmt(loop); });
+    }
+
+    bool TraverseCXXForRangeStmt(CXXForRangeStmt *loop)
+    {
+        return traverseLoop(loop,
+                            [&] { return RecursiveASTVisitor<FindLoopVisitor>::TraverseCXXForRangeStmt(loop); });
+    }
 
-        char *func_name_c = new char[func_name.length() + 1];
-        std::strcpy(func_name_c, func_name.c_str());
+    bool TraverseLambdaExpr(LambdaExpr *lambda)
+    {
+        return true;
+    }
 
-        char *timer_name_c = new char[timer_name.length() + 1];
-        std::strcpy(timer_name_c, timer_name.c_str());
+    bool TraverseCXXRecordDecl(CXXRecordDecl *decl)
+    {
+        return true;
+    }
 
-        std::string ret_name = encl_function->getReturnType().getAsString();
-        if (encl_function->getReturnType().getTypePtr()->isBooleanType() && ret_name.find("_Bool") != std::string::npos)
+  private:
+    template <typename Children> bool traverseLoop(Stmt *loop, Children traverse_children)
+    {
+        func_info *outer = parent;
+        depth++;
+        if (depth <= level)
         {
-            ret_name.replace(ret_name.find("_Bool"), 5, "bool");
+            if (func_info *info = makeLoopInstLocs(loop))
+            {
+                parent = info;
+            }
         }
-        if (ret_name.substr(0, 5).find("class") != std::string::npos)
+        bool result = traverse_children();
+        depth--;
+        parent = outer;
+        return result;
+    }
+
+    // returns null if the loop is not written out in its function's file (e.g. it comes from a macro)
+    func_info *makeLoopInstLocs(Stmt *loop)
+    {
+        SourceRange range = loop->getSourceRange();
+        if (range.getBegin().isMacroID() || range.getEnd().isMacroID() ||
+            src_mgr.getFileID(range.getBegin()) != parent->fid || src_mgr.getFileID(range.getEnd()) != parent->fid)
         {
-            ret_name = ret_name.substr(6); // if it starts with "class", chop that off
+            return nullptr;
         }
-        if (ret_name.substr(0, 11).find("const class") != std::string::npos)
+        // A loop ends after the ';' of an unbraced body or a do-while, else after its last token
+        SourceLocation after =
+            Lexer::findLocationAfterToken(range.getEnd(), tok::semi, src_mgr, context->getLangOpts(), false);
+        if (after.isInvalid())
         {
-            ret_name = ret_name.erase(6, 6); // if it starts with "class", chop that off
+            after = Lexer::getLocForEndOfToken(range.getEnd(), 0, src_mgr, context->getLangOpts());
         }
-
-        bool needs_move = false;
-        if (encl_function->getReturnType()->isClassType())
+        if (after.isInvalid() || src_mgr.getFileID(after) != parent->fid)
         {
-            CXXRecordDecl *decl = encl_function->getReturnType()->getAsCXXRecordDecl();
-            if (!(decl->hasSimpleCopyAssignment() || decl->hasTrivialCopyAssignment()))
-            {
-                needs_move = true;
-            }
+            return nullptr;
         }
 
-        char *ret_name_c = new char[ret_name.length() + 1];
-        std::strcpy(ret_name_c, ret_name.c_str());
-
-        inst_loc *ret = new inst_loc;
-        ret->line = start_line;
-        ret->col = start_col - 1;
-        ret->kind = start_line == end_line ? RETURN_FUNC : MULTILINE_RETURN_FUNC;
-        ret->func_name = func_name_c;
-        ret->return_type = ret_name_c;
-        ret->full_timer_name = timer_name_c;
-        ret->has_args = encl_function->getNumParams() > 0;
-        ret->is_return_ptr = encl_function->getReturnType()->isPointerType();
-        ret->needs_move = needs_move;
-
-        inst_locs.push_back(ret);
-
-        // llvm::outs() << "\tFound return at " << start_line << ":" << start_col << "\n";
+        FullSourceLoc start_loc = context->getFullLoc(range.getBegin());
+        FullSourceLoc end_loc = context->getFullLoc(range.getEnd());
+        FullSourceLoc after_loc = context->getFullLoc(after);
+
+        // TAU's loop timer name: the function's, with the loop's place in its file
+        std::string timer_name = "Loop: " + routine_of(parent)->full_timer_name.split('[').first.rtrim().str() +
+                                 " [{" + src_mgr.getFilename(start_loc).str() + "} {" +
+                                 std::to_string(start_loc.getSpellingLineNumber()) + "," +
+                                 std::to_string(start_loc.getSpellingColumnNumber()) + "}-{" +
+                                 std::to_string(end_loc.getSpellingLineNumber()) + "," +
+                                 std::to_string(end_loc.getSpellingColumnNumber()) + "}]";
+        func_info *info = inst.make_loop_info(parent, timer_name);
+
+        inst_loc *begin = inst.make_inst_loc(info);
+        begin->line = start_loc.getSpellingLineNumber();
+        begin->col = start_loc.getSpellingColumnNumber() - 1;
+        begin->kind = BEGIN_LOOP;
+        // just before the loop
+        begin->offset = src_mgr.getFileOffset(range.getBegin());
+        begin->end_offset = begin->offset;
+
+        inst_loc *end = inst.make_inst_loc(info);
+        end->line = after_loc.getSpellingLineNumber();
+        end->col = after_loc.getSpellingColumnNumber() - 1;
+        end->kind = END_LOOP;
+        // just after it
+        end->offset = src_mgr.getFileOffset(after);
+        end->end_offset = end->offset;
+
+        loops.push_back({begin->offset, end->offset, info});
+        return info;
     }
-
-    friend class FindFunctionVisitor;
 };
 
 class FindFunctionVisitor : public RecursiveASTVisitor<FindFunctionVisitor>
 {
     ASTContext *context;
     SourceManager &src_mgr;
+    instrumentor &inst;
     FindReturnVisitor return_visitor;
+    llvm::DenseSet<const FunctionDecl *> located;
 
   public:
-    explicit FindFunctionVisitor(ASTContext *context, SourceManager &SM)
-        : context(context), src_mgr(SM), return_visitor(context, SM)
+    explicit FindFunctionVisitor(ASTContext *context, SourceManager &SM, instrumentor &inst)
+        : context(context), src_mgr(SM), inst(inst), return_visitor(context, SM, inst)
     {
     }
 
@@ -610,22 +1200,113 @@ class FindFunctionVisitor : public RecursiveASTVisitor<FindFunctionVisitor>
         // if (func->isInlined()) {
         //     printf("Function %s is inline\n", func->getQualifiedNameAsString().c_str());
         // }
-        // short circuit on hasBody() first to protect check_func_against_list (and makeFuncInstLoc) from segfaults
+        // short circuit on hasBody() first to protect check_func_against_list (and makeFuncInstLoc) from segfaults,
+        // and on an empty include list so that no record is made for every inline function of the headers
         if (func->hasBody() &&
-            (!func->isInlined() || inst_inline || check_func_against_list(includelist, func, context, src_mgr)))
+            (!func->isInlined() || inst.inst_inline ||
+             (!includematcher.empty() &&
+              check_func_against_list(includematcher, inst.get_func_info(func, context, src_mgr)))))
         { //
-            makeFuncInstLoc(func);
-            return_visitor.encl_function = func;
-            return_visitor.TraverseDecl(func);
+            // Prototypes also report hasBody(); locate each definition only once
+            const FunctionDecl *definition = nullptr;
+            func->getBody(definition);
+            if (!located.insert(definition).second)
+            {
+                return true;
+            }
+            FunctionDecl *def = const_cast<FunctionDecl *>(definition);
+            llvm::TimeTraceScope trace_scope("VisitFunction", [def] { return def->getQualifiedNameAsString(); });
+            func_info *info = inst.get_func_info(def, context, src_mgr);
+            // returns only get a stop if the start could be placed
+            if (makeFuncInstLoc(def, info))
+            {
+                // A return stops the timed loops it leaves, so find them first
+                return_visitor.encl_function = info;
+                return_visitor.loops = findLoops(def, info);
+                return_visitor.TraverseDecl(def);
+                // main() carries the initialization, and a select file include wins over size
+                bool check_size =
+                    inst.size_thresholds.enabled() && !def->isMain() && !check_func_against_list(includematcher, info);
+                if (check_size || groups)
+                {
+                    salt::FunctionSize size = measure(def);
+                    // Whether it is called is only known after the whole translation unit, see
+                    // FindFunctionConsumer
+                    info->group = salt::GroupClassifier{group_small}.classify(def->isMain(), size, false);
+                    if (check_size)
+                    {
+                        skipIfTooSmall(def, info, size);
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    bool VisitCallExpr(CallExpr *call)
+    {
+        if (groups)
+        {
+            if (const FunctionDecl *callee = call->getDirectCallee())
+            {
+                inst.called_funcs.insert(callee->getCanonicalDecl());
+            }
         }
         return true;
     }
 
   private:
-    void makeFuncInstLoc(FunctionDecl *func)
+    // The loops of func to time, if the select file asks for any
+    std::vector<timed_loop> findLoops(FunctionDecl *func, func_info *info)
+    {
+        int level = loopInstrumentationLevel(info->full_timer_name.split('[').first, info->file);
+        if (level <= 0)
+        {
+            return {};
+        }
+        FindLoopVisitor loop_visitor(context, src_mgr, inst, info, level);
+        loop_visitor.TraverseStmt(func->getBody());
+        return std::move(loop_visitor.loops);
+    }
+
+    salt::FunctionSize measure(FunctionDecl *func)
+    {
+        FunctionSizeVisitor size_visitor;
+        size_visitor.TraverseStmt(func->getBody());
+        salt::FunctionSize size = size_visitor.size;
+        SourceRange range = func->getBody()->getSourceRange();
+        size.lines =
+            src_mgr.getSpellingLineNumber(range.getEnd()) - src_mgr.getSpellingLineNumber(range.getBegin()) + 1;
+        return size;
+    }
+
+    void skipIfTooSmall(FunctionDecl *func, func_info *info, const salt::FunctionSize &size)
+    {
+        if (!inst.size_thresholds.tooSmall(size))
+        {
+            return;
+        }
+
+        DPRINT("Skipping %s: %u statements, %u nodes, %u lines\n", info->func_name.str().c_str(), size.statements,
+               size.nodes, size.lines);
+        info->skip = true;
+        if (inst.size_report != nullptr)
+        {
+            inst.size_report->add({info->full_timer_name.split('[').first.trim().str(), info->file.str(),
+                                   src_mgr.getSpellingLineNumber(func->getBeginLoc()), size});
+        }
+    }
+
+    // returns false if the body's braces are not written out in its file (e.g. they come from a macro)
+    bool makeFuncInstLoc(FunctionDecl *func, func_info *info)
     {
         Stmt *func_body = func->getBody();
         SourceRange range = func_body->getSourceRange();
+        if (range.getBegin().isMacroID() || range.getEnd().isMacroID() ||
+            src_mgr.getFileID(range.getBegin()) != info->fid || src_mgr.getFileID(range.getEnd()) != info->fid)
+        {
+            return false;
+        }
 
         FullSourceLoc start_loc = context->getFullLoc(range.getBegin());
         FullSourceLoc end_loc = context->getFullLoc(range.getEnd());
@@ -635,71 +1316,24 @@ class FindFunctionVisitor : public RecursiveASTVisitor<FindFunctionVisitor>
         unsigned int end_line = end_loc.getSpellingLineNumber();
         unsigned int end_col = end_loc.getSpellingColumnNumber();
 
-        std::string func_name;
-        std::string timer_name;
-
-        makeFuncAndTimerNames(func, context, src_mgr, func_name, timer_name);
-
-        char *func_name_c = new char[func_name.length() + 1];
-        std::strcpy(func_name_c, func_name.c_str());
-
-        char *timer_name_c = new char[timer_name.length() + 1];
-        std::strcpy(timer_name_c, timer_name.c_str());
-
-        std::string ret_name = func->getReturnType().getAsString();
-        // why
-        if (func->getReturnType().getTypePtr()->isBooleanType() && ret_name.find("_Bool") != std::string::npos)
-        {
-            ret_name.replace(ret_name.find("_Bool"), 5, "bool ");
-        }
-        if (ret_name.substr(0, 5).find("class") != std::string::npos)
-        {
-            ret_name = ret_name.substr(6); // if it starts with "class", chop that off
-        }
-        if (ret_name.substr(0, 11).find("const class") != std::string::npos)
-        {
-            ret_name = ret_name.erase(6, 6); // if it starts with "class", chop that off
-        }
-        char *ret_name_c = new char[ret_name.length() + 1];
-        std::strcpy(ret_name_c, ret_name.c_str());
-
-        bool needs_move = false;
-        if (func->getReturnType()->isClassType())
-        {
-            CXXRecordDecl *decl = func->getReturnType()->getAsCXXRecordDecl();
-            if (!(decl->hasSimpleCopyAssignment() || decl->hasTrivialCopyAssignment()))
-            {
-                needs_move = true;
-            }
-        }
-
-        inst_loc *start = new inst_loc;
+        inst_loc *start = inst.make_inst_loc(info);
         start->line = start_line;
         start->col = start_col;
         start->kind = BEGIN_FUNC;
-        start->return_type = ret_name_c;
-        start->func_name = func_name_c;
-        start->full_timer_name = timer_name_c;
-        start->has_args = func->getNumParams() > 0;
-        start->is_return_ptr = func->getReturnType()->isPointerType();
-        start->needs_move = needs_move;
+        // just after the '{'
+        start->offset = src_mgr.getFileOffset(range.getBegin()) + 1;
+        start->end_offset = start->offset;
 
-        inst_locs.push_back(start);
-
-        inst_loc *end = new inst_loc;
+        inst_loc *end = inst.make_inst_loc(info);
         end->line = end_line;
         end->col = end_col - 1;
         end->kind = RETURN_FUNC;
-        end->return_type = ret_name_c;
-        end->func_name = func_name_c;
-        end->full_timer_name = timer_name_c;
-        end->has_args = func->getNumParams() > 0;
-        end->is_return_ptr = func->getReturnType()->isPointerType();
-        end->needs_move = needs_move;
-
-        inst_locs.push_back(end);
+        // just before the '}'
+        end->offset = src_mgr.getFileOffset(range.getEnd());
+        end->end_offset = end->offset;
 
         // llvm::outs() << "Found function " << timer_name << "\n";
+        return true;
     }
 };
 
@@ -707,14 +1341,23 @@ class FindFunctionConsumer : public clang::ASTConsumer
 {
     FindFunctionVisitor func_visitor;
     SourceManager &src_mgr;
+    instrumentor &inst;
+    std::vector<std::string> &files_to_go;
 
   public:
-    FindFunctionConsumer(ASTContext *context, SourceManager &SM) : func_visitor(context, SM), src_mgr(SM)
+    FindFunctionConsumer(ASTContext *context, SourceManager &SM, instrumentor &inst)
+        : func_visitor(context, SM, inst), src_mgr(SM), inst(inst), files_to_go(inst.files_to_go)
     {
     }
 
     virtual void HandleTranslationUnit(ASTContext &context)
     {
+        salt::PhaseTimer visit_timer(inst.timing, salt::Phase::Visit);
+        llvm::TimeTraceScope trace_scope("HandleTranslationUnit", [this] {
+            return src_mgr.getBufferName(src_mgr.getLocForStartOfFile(src_mgr.getMainFileID())).str();
+        });
+        // instrument() rewrites this copy instead of reading the file again
+        inst.save_main_buffer(src_mgr);
         auto decls = context.getTranslationUnitDecl()->decls();
         for (auto &decl : decls)
         {
@@ -730,8 +1373,8 @@ class FindFunctionConsumer : public clang::ASTConsumer
             // except for things in the exclude list
             if (!fileincludelist.empty())
             {
-                if (check_file_against_list(fileincludelist, src_mgr.getFilename(srcloc).str()) &&
-                    !check_file_against_list(fileexcludelist, src_mgr.getFilename(srcloc).str()))
+                if (check_file_against_list(fileincludematcher, src_mgr.getFilename(srcloc).str()) &&
+                    !check_file_against_list(fileexcludematcher, src_mgr.getFilename(srcloc).str()))
                 {
                     // printf("adding1 %s\n", src_mgr.getFilename(srcloc).str().c_str());
                     if (!src_mgr.getFilename(srcloc).str().empty() &&
@@ -746,7 +1389,7 @@ class FindFunctionConsumer : public clang::ASTConsumer
             // if file include list does not exist, just check against exclude list
             else
             {
-                if (!check_file_against_list(fileexcludelist, src_mgr.getFilename(srcloc).str()))
+                if (!check_file_against_list(fileexcludematcher, src_mgr.getFilename(srcloc).str()))
                 {
                     // decl->dump();
                     // printf("adding2 %s\n", src_mgr.getFilename(srcloc).str().c_str());
@@ -761,15 +1404,50 @@ class FindFunctionConsumer : public clang::ASTConsumer
                 }
             }
         }
+        // --salt_groups: a function that makes calls is interior if it is also called
+        if (groups)
+        {
+            for (auto &entry : inst.func_table)
+            {
+                if (entry.second->group == salt::FunctionGroup::TopLevel &&
+                    inst.called_funcs.count(entry.first->getCanonicalDecl()))
+                {
+                    entry.second->group = salt::FunctionGroup::Interior;
+                }
+            }
+        }
     }
 };
 
 class FindFunctionAction : public ASTFrontendAction
 {
+    instrumentor &inst;
+
   public:
+    explicit FindFunctionAction(instrumentor &inst) : inst(inst)
+    {
+    }
+
     virtual std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Compiler, llvm::StringRef InFile)
     {
-        return std::make_unique<FindFunctionConsumer>(&Compiler.getASTContext(), Compiler.getSourceManager());
+        return std::make_unique<FindFunctionConsumer>(&Compiler.getASTContext(), Compiler.getSourceManager(), inst);
+    }
+};
+
+// newFrontendActionFactory<T>() can only default-construct its actions, so
+// hand each action the instrumentor that owns the translation unit's state.
+class FindFunctionActionFactory : public tooling::FrontendActionFactory
+{
+    instrumentor &inst;
+
+  public:
+    explicit FindFunctionActionFactory(instrumentor &inst) : inst(inst)
+    {
+    }
+
+    std::unique_ptr<FrontendAction> create() override
+    {
+        return std::make_unique<FindFunctionAction>(inst);
     }
 };
 
@@ -778,139 +1456,252 @@ instrumentor::instrumentor()
     // Constructor currently does not need to do anything
 }
 
+instrumentor::~instrumentor()
+{
+    delete Tool;
+    free(exec_name);
+}
+
+inst_loc *instrumentor::make_inst_loc(func_info *func)
+{
+    if (!arena)
+    {
+        arena = std::make_unique<loc_arena>();
+    }
+    inst_loc *loc = new (arena->alloc.Allocate<inst_loc>()) inst_loc;
+    loc->func = func;
+    locs_by_file[func->file].push_back(loc);
+    return loc;
+}
+
+void instrumentor::release_locs()
+{
+    funcs.clear();
+    funcs.shrink_to_fit();
+    func_table.clear();
+    called_funcs.clear();
+    locs_by_file.clear();
+    real_paths.clear();
+    file_buffers.clear();
+    arena.reset();
+}
+
 void instrumentor::set_exec_name(const char* name)
 {
     exec_name = strdup(name);
 }
 
-void instrumentor::run_tool()
+int instrumentor::run_tool()
 {
-    Tool->run(tooling::newFrontendActionFactory<FindFunctionAction>().get());
+    FindFunctionActionFactory factory(*this);
+    return Tool->run(&factory);
 }
 
-void instrumentor::instr_request(std::list<std::string> list, bool include)
+std::string instrumentor::inst_file_name(const std::string &fname) const
 {
-    for (inst_loc *loc : inst_locs)
+    if (!outputfile.empty())
     {
-        if (check_loc_against_list(list, loc))
-        {
-            loc->skip = !include;
-        }
+        return outputfile;
+    }
+
+    std::string newname = fname;
+    auto location = fname.find_last_of("/\\");
+    if (location != std::string::npos && !inst_beside_source)
+    {
+        newname = fname.substr(location + 1);
+    }
+    location = newname.find_last_of(".");
+    // don't mistake a dot in a directory name for the extension
+    auto dir_location = newname.find_last_of("/\\");
+    if (location != std::string::npos && (dir_location == std::string::npos || location > dir_location))
+    {
+        newname.insert(location, ".inst");
+    }
+    else
+    {
+        newname.append(".inst");
     }
+    return newname;
 }
 
-void instrumentor::instrument_file(std::ifstream &og_file, std::ofstream &inst_file, std::string filename,
-                     std::vector<inst_loc *> inst_locations, bool use_cxx_api, ryml::Tree yaml_tree)
+void instrumentor::instr_request(const salt::SelectMatcher &list, bool include)
 {
-    std::string line;
-    int lineno = 0;
-
-    auto inst_loc_iter = inst_locations.begin();
-
-    for (ryml::NodeRef const& child : yaml_tree["include"].children()) {
-        inst_file << "#include " << child.val() << "\n";
+    llvm::TimeTraceScope trace_scope("instr_request");
+    for (func_info *func : funcs)
+    {
+        if (check_func_against_list(list, func))
+        {
+            func->skip = !include;
+        }
     }
+}
 
-    inst_file << "#line 1 \"" << filename << "\"\n";
-
-    while (getline(og_file, line))
+bool instrumentor::instrument_file(llvm::StringRef source, std::ofstream &inst_file, std::string filename,
+                     std::vector<inst_loc *> inst_locations, const std::vector<func_info *> &timers,
+                     bool use_cxx_api, const inst_config &config)
+{
+    llvm::TimeTraceScope trace_scope("instrument_file", filename);
+    // Every location becomes one edit of source. Edits that touch (several
+    // insertions at one offset, a stop right after a return) are merged in
+    // location order, so the Replacements never conflict.
+    std::vector<tooling::Replacement> edits;
+    for (inst_loc *loc : inst_locations)
     {
-        lineno++;
-        // short circuit if we run out of inst locations to avoid segfaults :)
-        // need the if and the while because sometimes 2+ inst locations are on the same line
-        if (inst_loc_iter != inst_locations.end())
+        if (loc->func->skip || loc->end_offset > source.size())
+        {
+            continue;
+        }
+        std::string code;
+        int end_line = loc->line;
+        switch (loc->kind)
         {
-            inst_loc *curr_inst_loc = *inst_loc_iter;
-            if (lineno == curr_inst_loc->line)
+        case BEGIN_FUNC:
+            make_begin_func_code(loc, code, config, use_cxx_api);
+            break;
+        case BEGIN_LOOP:
+            make_begin_loop_code(loc, code, config, use_cxx_api);
+            break;
+        case END_LOOP:
+            make_end_loop_code(loc, code, config, use_cxx_api);
+            break;
+        case RETURN_FUNC:
+        case MULTILINE_RETURN_FUNC:
+            if (use_cxx_api)
             {
-                curr_inst_loc = *inst_loc_iter;
-                int num_inst_locs_this_line = 0;
-                std::string start = line.substr(0, curr_inst_loc->col);
-                std::string end;
-                while (inst_loc_iter != inst_locations.end() && lineno == curr_inst_loc->line)
+                continue;
+            }
+            if (loc->offset == loc->end_offset)
+            {
+                // closing brace: don't put anything in for non-void functions missing explicit return
+                // if we have int main() with no explicit return, use -optDisable hack
+                // -glares at cmake-
+                if (!loc->func->return_type.contains("void"))
                 {
-                    if (curr_inst_loc->col < line.size())
-                    {
-                        end = line.substr(curr_inst_loc->col);
-                    }
-                    else
-                    {
-                        end = "";
-                    }
-                    if (num_inst_locs_this_line == 0)
-                    {
-                        inst_file << start;
-                    }
-                    std::string inst_code = "";
-                    switch (curr_inst_loc->kind)
-                    {
-                    case BEGIN_FUNC:
-                        inst_file << "\n#line " << lineno << "\n";
-                        make_begin_func_code(curr_inst_loc, inst_code, yaml_tree, use_cxx_api);
-                        inst_file << inst_code;
-                        inst_file << "#line " << lineno << "\n";
-                        break;
-                    case RETURN_FUNC:
-                        if (!use_cxx_api)
-                        {
-                            inst_file << "\n#line " << lineno << "\n";
-                            make_end_func_code(curr_inst_loc, inst_code, line, yaml_tree);
-                            inst_file << inst_code;
-                            inst_file << "#line " << lineno << "\n";
-                            if (line.find("return", curr_inst_loc->col) != std::string::npos &&
-                                line.find(";", line.find("return", curr_inst_loc->col)) != std::string::npos)
-                            {
-                                end = line.substr(line.find(";", line.find("return", curr_inst_loc->col)) + 1);
-                            }
-                        }
-                        break;
-                    case MULTILINE_RETURN_FUNC:
-                        if (!use_cxx_api)
-                        {
-                            inst_file << "\n#line " << lineno << "\n";
-                            // join all the lines together into one so make_end_func_code can actually know what's
-                            // happening
-                            while (line.find(";") == std::string::npos)
-                            {
-                                std::string templine;
-                                getline(og_file, templine);
-                                line += templine;
-                                lineno++;
-                            }
-                            make_end_func_code(curr_inst_loc, inst_code, line, yaml_tree);
-                            inst_file << inst_code;
-                            inst_file << "#line " << lineno << "\n";
-                            if (line.find("return", curr_inst_loc->col) != std::string::npos &&
-                                line.find(";", line.find("return", curr_inst_loc->col)) != std::string::npos)
-                            {
-                                end = line.substr(line.find(";", line.find("return", curr_inst_loc->col)) + 1);
-                            }
-                        }
-                    default:
-                        break;
-                    }
-
-                    inst_loc_iter++;
-                    curr_inst_loc = *inst_loc_iter;
-                    num_inst_locs_this_line++;
+                    continue;
                 }
-
-                inst_file << end << "\n";
+                // if it is void, put in stop just in case
+                expand_end_snippet(config, loc->func, code, "\t", "\n");
             }
             else
             {
-                inst_file << line << "\n";
+                llvm::StringRef stmt = source.slice(loc->offset, loc->end_offset);
+                // between "return" and ';'
+                llvm::StringRef value = stmt.drop_front(6).drop_back(1).trim();
+                make_return_code(loc, code, value, config);
+                end_line += stmt.count('\n');
             }
+            break;
+        default:
+            continue;
+        }
+
+        std::string text = "\n#line " + std::to_string(loc->line) + "\n" + code + "#line " +
+                           std::to_string(end_line) + "\n";
+        if (!edits.empty() && edits.back().getOffset() + edits.back().getLength() == loc->offset)
+        {
+            const tooling::Replacement &last = edits.back();
+            std::string merged = last.getReplacementText().str() + text;
+            edits.back() = tooling::Replacement(filename, last.getOffset(),
+                                                last.getLength() + loc->end_offset - loc->offset, merged);
+        }
+        else if (!edits.empty() && edits.back().getOffset() + edits.back().getLength() > loc->offset)
+        {
+            DPRINT("dropping overlapping location at %d:%d\n", loc->line, loc->col);
         }
         else
         {
-            inst_file << line << "\n";
+            edits.emplace_back(filename, loc->offset, loc->end_offset - loc->offset, text);
+        }
+    }
+
+    // Writing the source with an edit missing would silently leave part of it uninstrumented
+    tooling::Replacements replacements;
+    for (const tooling::Replacement &edit : edits)
+    {
+        if (llvm::Error err = replacements.add(edit))
+        {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "ERROR: cannot instrument " + filename + ": ");
+            return false;
+        }
+    }
+    llvm::Expected<std::string> rewritten = tooling::applyAllReplacements(source, replacements);
+    if (!rewritten)
+    {
+        std::lock_guard<std::mutex> lock(output_mutex);
+        llvm::logAllUnhandledErrors(rewritten.takeError(), llvm::errs(), "ERROR: cannot instrument " + filename + ": ");
+        return false;
+    }
+
+    for (const std::string &include : config.includes) {
+        inst_file << "#include " << include << "\n";
+    }
+    if (groups)
+    {
+        inst_file << salt::groupPrelude();
+    }
+    if (throttle)
+    {
+        inst_file << throttle_prelude;
+    }
+    if (enable_table && !timers.empty())
+    {
+        inst_file << enable_prelude << make_enable_table(timers);
+    }
+
+    inst_file << "#line 1 \"" << filename << "\"\n";
+    inst_file << *rewritten;
+    return true;
+}
+
+std::vector<func_info *> instrumentor::number_timers(llvm::StringRef file, const std::vector<inst_loc *> &locs)
+{
+    // The locations, and the arena holding them, exist only if something is instrumented
+    if (locs.empty())
+    {
+        return {};
+    }
+    std::string table = "salt_" + llvm::utohexstr(llvm::xxh3_64bits(llvm::arrayRefFromStringRef(file)),
+                                                  /*LowerCase=*/true);
+    llvm::StringRef saved_table = arena->strings.save(table);
+    std::vector<func_info *> timers;
+    for (inst_loc *loc : locs)
+    {
+        if ((loc->kind != BEGIN_FUNC && loc->kind != BEGIN_LOOP) || loc->func->skip)
+        {
+            continue;
+        }
+        std::string index = std::to_string(timers.size());
+        loc->func->timer_index = arena->strings.save(index);
+        loc->func->timer_table = saved_table;
+        if (timer_ids)
+        {
+            loc->func->timer_key = arena->strings.save(table + ":" + index);
         }
+        timers.push_back(loc->func);
+    }
+    return timers;
+}
+
+bool instrumentor::write_timer_table(const std::string &path, const std::string &source,
+                                     const std::vector<func_info *> &timers)
+{
+    std::ofstream table(path);
+    if (!table)
+    {
+        return false;
+    }
+    table << "# SALT-FM timer table of " << source << ": <timer_table>:<timer_index>\t<full_timer_name>\n";
+    for (const func_info *func : timers)
+    {
+        table << func->timer_key.str() << "\t" << func->full_timer_name.str() << "\n";
     }
+    return static_cast<bool>(table);
 }
 
-void instrumentor::instrument()
+bool instrumentor::instrument()
 {
+    bool ok = true;
     // printf("size %zu\n", files_to_go.size());
     // for (std::string fname : files_to_go) {
     //     printf("Instrumenting %s\n", fname.c_str());
@@ -935,32 +1726,19 @@ void instrumentor::instrument()
             continue;
         }
         DPRINT("Instrumenting %s\n", fname.c_str());
+        // the visitors already bucketed the locations by the real path of their file
+        llvm::SmallString<256> real_name;
+        if (llvm::sys::fs::real_path(fname, real_name))
+        {
+            real_name = fname;
+        }
         std::vector<inst_loc *> inst_locations;
-
-        DPRINT0("filtering locations for file\n");
-        // filter on fname
-        for (inst_loc *loc : inst_locs)
+        auto bucket = locs_by_file.find(real_name);
+        if (bucket != locs_by_file.end())
         {
-            std::string timer_name = std::string(loc->full_timer_name);
-            // grab contents of first set of curly braces, which is filename
-            std::string loc_fname = timer_name.substr(timer_name.find_first_of("{") + 1,
-                                                    timer_name.find_first_of("}") - timer_name.find_first_of("{") - 1);
-            // printf("loc file %s\n", loc_fname.c_str());
-            // printf("cur file %s\n", fname.c_str());
-            if (loc_fname.find(fname) != std::string::npos || fname.find(loc_fname) != std::string::npos)
-            {
-                inst_locations.push_back(loc);
-            }
+            inst_locations = std::move(bucket->second);
         }
 
-        // inst_locs.begin(), inst_locs.end(), inst_locations.begin(),
-        // [&](inst_loc* loc) {
-        //     std::string timer_name = std::string(loc->full_timer_name);
-        //     // grab contents of first set of curly braces, which is filename
-        //     std::string loc_fname = timer_name.substr(timer_name.find_first_of("{")+1, timer_name.find_first_of("}") -
-        //     timer_name.find_first_of("{")-1); printf("loc file %s\n", loc_fname.c_str()); printf("cur file %s\n",
-        //     fname.c_str()); return trim(loc_fname) == trim(fname);
-        // });
         // sort by line numbers then cols (then loc type) so looping goes well
         std::sort(inst_locations.begin(), inst_locations.end(), comp_inst_loc);
         // unique again just in case
@@ -971,101 +1749,126 @@ void instrumentor::instrument()
         // dump_all_locs(inst_locations);
         // }
 
-        std::ifstream og_file;
-        std::ofstream inst_file;
-        std::string newname = fname;
-        if (!outputfile.empty())
-        {
-            newname = outputfile;
-        }
-        else
+        // A loop is timed only along with its function
+        for (inst_loc *loc : inst_locations)
         {
-            auto location = fname.find_last_of("/\\");
-            if (location != std::string::npos)
-            {
-                newname = fname.substr(location + 1);
-            }
-            else
+            if (loc->func->parent != nullptr)
             {
-                newname = fname;
-            }
-            location = newname.find_last_of(".");
-            if (location != std::string::npos)
-            {
-                newname.insert(newname.find_last_of("."), ".inst");
-            }
-            else
-            {
-                newname.append(".inst");
+                loc->func->skip = routine_of(loc->func)->skip;
             }
         }
-        DPRINT("new filename (inst): %s\n", newname.c_str());
 
-        inst_file.open(newname);
-        og_file.open(fname);
+        std::vector<func_info *> timers = number_timers(real_name, inst_locations);
 
-        // check for cxxparse executable name. If so, force cxx api usage
+        // check for cxxparse executable name. If so, force cxx api usage.
+        // Kept local: the option itself is shared by all worker threads.
+        bool cxx_api = use_cxx_api;
         if (strstr(exec_name, "cxxparse") != nullptr)
         {
-            use_cxx_api = true;
+            cxx_api = true;
             DPRINT("%s: Forcing TAU CXX API\n", exec_name);
             fflush(stdout);
         }
-
-        // Read config.yaml
-        ryml::Tree yaml_tree;
-        if (FILE *config_file = fopen(configfile.c_str(), "r"))
+        // A scoped timer cannot be skipped by the --salt_throttle guard or
+        // the --salt_enable_table test; runRequest() rejected an explicit
+        // --tau_use_cxx_api and warned about the cxxparse default
+        if (throttle || enable_table)
         {
-            std::ifstream inputStream{configfile.c_str()};
-            if (!inputStream) {
-                llvm::errs() << "ERROR: Could not open configuration file " << configfile.c_str() << "\n";
-                std::exit(-3);
-            }
-            std::stringstream configStream;
-            configStream << inputStream.rdbuf();
-            yaml_tree = ryml::parse_in_arena(ryml::to_csubstr(configStream.str()));
-
-            fclose(config_file);
+            cxx_api = false;
         }
-        else
+
+        // Read config.yaml (parsed only by the first file of the process)
+        salt::PhaseTimer config_timer(timing, salt::Phase::Config);
+        std::shared_ptr<const inst_config> shared_config = get_inst_config();
+        config_timer.stop();
+        if (!shared_config)
         {
-            llvm::outs() << "No config file found\n";
-            remove(newname.c_str());
-            exit(1);
+            return false;
         }
+        const inst_config &config = *shared_config;
 
         // If using C++ API, check that config file contains code for scoped instrumentation
-        if (use_cxx_api) {
-            if (ryml::ConstNodeRef mainInsertScope = yaml_tree["main_insert_scope"]; mainInsertScope.invalid()) {
+        if (cxx_api) {
+            if (!config.has_main_insert_scope) {
                llvm::errs() << "Using C++ Instrumentation API requires `main_insert_scope` in config file.\n";
-                exit(2);
+                return false;
             }
-            if (ryml::ConstNodeRef functionBeginScope = yaml_tree["function_begin_insert_scope"]; functionBeginScope.
-                invalid()) {
+            if (!config.has_function_begin_insert_scope) {
                 llvm::errs() << "Using C++ Instrumentation API requires `function_begin_insert_scope` in config file.\n";
-                exit(2);
+                return false;
             }
         }
 
-        llvm::outs() << "Instrumentation: " << yaml_tree["instrumentation"].val() << "\n";
-        instrument_file(og_file, inst_file, fname, inst_locations, use_cxx_api, yaml_tree);
-        og_file.close();
+        // Rewrite the text the AST was built from; only read the file if the
+        // parse never got to it
+        llvm::StringRef source;
+        std::unique_ptr<llvm::MemoryBuffer> disk_copy;
+        auto buffer = file_buffers.find(real_name);
+        if (buffer != file_buffers.end())
+        {
+            source = buffer->second;
+        }
+        else if (llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> read = llvm::MemoryBuffer::getFile(fname))
+        {
+            disk_copy = std::move(*read);
+            source = disk_copy->getBuffer();
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            llvm::errs() << "ERROR: could not read " << fname << ": " << read.getError().message() << "\n";
+            continue;
+        }
+
+        salt::PhaseTimer rewrite_timer(timing, salt::Phase::Rewrite);
+        std::ofstream inst_file;
+        std::string newname = inst_file_name(fname);
+        DPRINT("new filename (inst): %s\n", newname.c_str());
+
+        inst_file.open(newname);
+
+        {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            llvm::outs() << "Instrumentation: " << config.instrumentation << "\n";
+            llvm::outs().flush();
+        }
+        if (!instrument_file(source, inst_file, fname, inst_locations, timers, cxx_api, config))
+        {
+            // No output rather than an uninstrumented one the build would use
+            inst_file.close();
+            llvm::sys::fs::remove(newname);
+            ok = false;
+            continue;
+        }
         inst_file.close();
+        outputs.push_back({fname, newname, true, config.instrumentation});
+        if (timer_ids && !write_timer_table(newname + ".timers", fname, timers))
+        {
+            // The output's timer keys cannot be resolved without it
+            std::lock_guard<std::mutex> lock(output_mutex);
+            llvm::errs() << "ERROR: could not write the timer table " << newname << ".timers\n";
+            ok = false;
+        }
+        rewrite_timer.stop();
+
+        if (timing != nullptr)
+        {
+            for (inst_loc *loc : inst_locations)
+            {
+                if (loc->kind == BEGIN_FUNC && !loc->func->skip)
+                {
+                    timing->functionsInstrumented++;
+                }
+            }
+        }
     }
 
     for (std::string fname : files_skipped)
     {
         std::ifstream og_file;
         std::ofstream inst_file;
-        std::string newname = fname;
-        if (!outputfile.empty())
-        {
-            newname = outputfile;
-        }
-        else
-        {
-            newname.insert(newname.find_last_of("."), ".inst");
-        }
+        // Named by the same rule as an instrumented output
+        std::string newname = inst_file_name(fname);
         DPRINT("new filename (skip): %s\n", newname.c_str());
 
         inst_file.open(newname);
@@ -1075,5 +1878,10 @@ void instrumentor::instrument()
 
         og_file.close();
         inst_file.close();
+        outputs.push_back({fname, newname, false});
     }
+
+    // Every file has been written; nothing refers to the locations any more
+    release_locs();
+    return ok;
 }
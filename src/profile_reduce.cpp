@@ -0,0 +1,405 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "profile_reduce.hpp"
+
+#include <algorithm>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+namespace {
+    // The name a select file matches a timer by, or "" for routines that cannot be excluded
+    llvm::StringRef routineName(llvm::StringRef timerName) {
+        llvm::StringRef name = timerName.split('[').first.trim();
+        // TAU's own timers (".TAU application"), callpaths, and names a select file cannot quote
+        if (name.empty() || name.starts_with(".") || name.contains(" => ") || name.contains('"')) {
+            return {};
+        }
+        return name;
+    }
+
+    double perCall(double usec, double calls) {
+        return calls > 0 ? usec / calls : 0;
+    }
+}
+
+std::optional<salt::ReduceRule> salt::ReduceRule::parse(const llvm::StringRef text, std::string &error) {
+    ReduceRule rule;
+    rule.text_ = text.trim().str();
+
+    llvm::SmallVector<llvm::StringRef, 4> terms;
+    llvm::StringRef(rule.text_).split(terms, '&', -1, false);
+    for (llvm::StringRef term: terms) {
+        term = term.trim();
+        const size_t opPos = term.find_first_of("<>=!");
+        if (term.empty() || opPos == llvm::StringRef::npos) {
+            error = "expected <field> <op> <number> in rule \"" + rule.text_ + "\"";
+            return std::nullopt;
+        }
+
+        Condition condition{};
+        llvm::StringRef op = term.substr(opPos, 2);
+        if (op == "<=") {
+            condition.op = Op::LessEqual;
+        } else if (op == ">=") {
+            condition.op = Op::GreaterEqual;
+        } else if (op == "==") {
+            condition.op = Op::Equal;
+        } else if (op == "!=") {
+            condition.op = Op::NotEqual;
+        } else if (op[0] == '<') {
+            condition.op = Op::Less;
+            op = op.take_front();
+        } else if (op[0] == '>') {
+            condition.op = Op::Greater;
+            op = op.take_front();
+        } else {
+            error = "unknown operator in rule \"" + rule.text_ + "\"";
+            return std::nullopt;
+        }
+
+        std::string field = term.take_front(opPos).lower();
+        field.erase(std::remove_if(field.begin(), field.end(), llvm::isSpace), field.end());
+        if (field == "calls" || field == "numcalls") {
+            condition.field = Field::Calls;
+        } else if (field == "subrs" || field == "numsubrs") {
+            condition.field = Field::Subrs;
+        } else if (field == "usec") {
+            condition.field = Field::Usec;
+        } else if (field == "cumusec") {
+            condition.field = Field::CumUsec;
+        } else if (field == "usec/call") {
+            condition.field = Field::UsecPerCall;
+        } else if (field == "cumusec/call") {
+            condition.field = Field::CumUsecPerCall;
+        } else {
+            error = "unknown field \"" + field + "\" in rule \"" + rule.text_ + "\"";
+            return std::nullopt;
+        }
+
+        if (!llvm::to_float(term.drop_front(opPos + op.size()).trim(), condition.value)) {
+            error = "expected a number in rule \"" + rule.text_ + "\"";
+            return std::nullopt;
+        }
+        rule.conditions_.push_back(condition);
+    }
+
+    if (rule.conditions_.empty()) {
+        error = "empty rule";
+        return std::nullopt;
+    }
+    return rule;
+}
+
+bool salt::ReduceRule::matches(const ProfileEntry &entry) const {
+    return std::all_of(conditions_.cbegin(), conditions_.cend(), [&entry](const Condition &condition) {
+        double value = 0;
+        switch (condition.field) {
+            case Field::Calls:
+                value = entry.calls;
+                break;
+            case Field::Subrs:
+                value = entry.subrs;
+                break;
+            case Field::Usec:
+                value = entry.exclusiveUsec;
+                break;
+            case Field::CumUsec:
+                value = entry.inclusiveUsec;
+                break;
+            case Field::UsecPerCall:
+                value = perCall(entry.exclusiveUsec, entry.calls);
+                break;
+            case Field::CumUsecPerCall:
+                value = perCall(entry.inclusiveUsec, entry.calls);
+                break;
+        }
+        switch (condition.op) {
+            case Op::Less:
+                return value < condition.value;
+            case Op::LessEqual:
+                return value <= condition.value;
+            case Op::Greater:
+                return value > condition.value;
+            case Op::GreaterEqual:
+                return value >= condition.value;
+            case Op::Equal:
+                return value == condition.value;
+            case Op::NotEqual:
+                return value != condition.value;
+        }
+        return false;
+    });
+}
+
+bool salt::ProfileReduction::addRules(const llvm::StringRef text, std::string &error) {
+    llvm::SmallVector<llvm::StringRef, 4> lines;
+    text.split(lines, ';', -1, false);
+    for (llvm::StringRef line: lines) {
+        llvm::SmallVector<llvm::StringRef, 4> ruleTexts;
+        line.split(ruleTexts, '\n', -1, false);
+        for (llvm::StringRef ruleText: ruleTexts) {
+            if (ruleText.trim().empty()) {
+                continue;
+            }
+            std::optional<ReduceRule> rule = ReduceRule::parse(ruleText, error);
+            if (!rule) {
+                return false;
+            }
+            rules.push_back(std::move(*rule));
+        }
+    }
+    return true;
+}
+
+bool salt::ProfileReduction::readProfile(const llvm::StringRef path, std::string &error) {
+    if (llvm::sys::fs::is_directory(path)) {
+        // One profile.<node>.<context>.<thread> file per thread
+        std::vector<std::string> files;
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(path, ec), end; it != end && !ec; it.increment(ec)) {
+            if (llvm::sys::path::filename(it->path()).starts_with("profile.")) {
+                files.push_back(it->path());
+            }
+        }
+        if (ec) {
+            error = "cannot read profile directory " + path.str() + ": " + ec.message();
+            return false;
+        }
+        if (files.empty()) {
+            error = "no profile.* files in " + path.str();
+            return false;
+        }
+        std::sort(files.begin(), files.end());
+        return std::all_of(files.cbegin(), files.cend(), [this, &error](const std::string &file) {
+            return readProfile(file, error);
+        });
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFile(path);
+    if (!buffer) {
+        error = "cannot read profile " + path.str() + ": " + buffer.getError().message();
+        return false;
+    }
+    const llvm::StringRef content = (*buffer)->getBuffer();
+    if (content.ltrim().split('\n').first.contains("templated_functions")) {
+        return readTauProfile(path, content, error);
+    }
+    return readCSV(path, content, error);
+}
+
+// "<N> templated_functions[_MULTI_<metric>]", a "# Name Calls Subrs Excl Incl ..."
+// header, then N lines of "\"<name>\" <calls> <subrs> <excl> <incl> ... GROUP=\"<groups>\""
+bool salt::ProfileReduction::readTauProfile(const llvm::StringRef path, llvm::StringRef content,
+                                            std::string &error) {
+    const auto fail = [&error, path](unsigned lineno, const std::string &message) {
+        error = path.str() + ":" + std::to_string(lineno) + ": " + message;
+        return false;
+    };
+
+    unsigned lineno = 1;
+    llvm::StringRef line;
+    std::tie(line, content) = content.ltrim().split('\n');
+    unsigned count = 0;
+    if (!llvm::to_integer(line.split(' ').first, count)) {
+        return fail(lineno, "expected the number of functions");
+    }
+
+    for (unsigned i = 0; i < count;) {
+        if (content.empty()) {
+            return fail(lineno, "expected " + std::to_string(count) + " functions");
+        }
+        std::tie(line, content) = content.split('\n');
+        ++lineno;
+        line = line.trim();
+        if (line.empty() || line.starts_with("#")) {
+            continue;
+        }
+        ++i;
+
+        llvm::StringRef fields = line;
+        const size_t groupPos = line.rfind(" GROUP=\"");
+        if (groupPos != llvm::StringRef::npos) {
+            fields = line.take_front(groupPos);
+        }
+        const size_t nameEnd = fields.rfind('"');
+        if (!fields.starts_with("\"") || nameEnd == 0 || nameEnd == llvm::StringRef::npos) {
+            return fail(lineno, "expected a quoted function name");
+        }
+        ProfileEntry entry;
+        entry.name = fields.slice(1, nameEnd).str();
+        llvm::SmallVector<llvm::StringRef, 8> numbers;
+        fields.drop_front(nameEnd + 1).split(numbers, ' ', -1, false);
+        if (numbers.size() < 4 || !llvm::to_float(numbers[0], entry.calls) ||
+            !llvm::to_float(numbers[1], entry.subrs) || !llvm::to_float(numbers[2], entry.exclusiveUsec) ||
+            !llvm::to_float(numbers[3], entry.inclusiveUsec)) {
+            return fail(lineno, "expected calls, subroutines, exclusive and inclusive time");
+        }
+        add(std::move(entry));
+    }
+    return true;
+}
+
+// "name,calls,inclusive_usec[,exclusive_usec]" with an optional header line.
+// C++ names hold commas, so an unquoted name is everything before the numbers.
+bool salt::ProfileReduction::readCSV(const llvm::StringRef path, llvm::StringRef content, std::string &error) {
+    unsigned lineno = 0;
+    bool seenData = false;
+    while (!content.empty()) {
+        llvm::StringRef line;
+        std::tie(line, content) = content.split('\n');
+        ++lineno;
+        line = line.trim();
+        if (line.empty() || line.starts_with("#")) {
+            continue;
+        }
+
+        std::string name;
+        llvm::StringRef rest;
+        if (line.starts_with("\"")) {
+            // A quoted field, with "" for a quote
+            size_t pos = 1;
+            for (; pos < line.size(); ++pos) {
+                if (line[pos] == '"') {
+                    if (pos + 1 < line.size() && line[pos + 1] == '"') {
+                        name += '"';
+                        ++pos;
+                        continue;
+                    }
+                    break;
+                }
+                name += line[pos];
+            }
+            rest = line.drop_front(pos + 1).ltrim();
+            if (!rest.consume_front(",")) {
+                error = path.str() + ":" + std::to_string(lineno) + ": expected ',' after the quoted name";
+                return false;
+            }
+        } else {
+            // Peel numeric fields off the end
+            llvm::StringRef head = line;
+            for (unsigned numbers = 0; numbers < 3; ++numbers) {
+                const auto [before, last] = head.rsplit(',');
+                double value = 0;
+                if (before.size() == head.size() || !llvm::to_float(last.trim(), value)) {
+                    break;
+                }
+                head = before;
+            }
+            name = head.trim().str();
+            rest = line.drop_front(head.size()).ltrim(',');
+        }
+
+        llvm::SmallVector<llvm::StringRef, 3> numbers;
+        rest.split(numbers, ',');
+        ProfileEntry entry;
+        entry.name = std::move(name);
+        if (numbers.size() < 2 || numbers.size() > 3 || !llvm::to_float(numbers[0].trim(), entry.calls) ||
+            !llvm::to_float(numbers[1].trim(), entry.inclusiveUsec) ||
+            (numbers.size() == 3 && !llvm::to_float(numbers[2].trim(), entry.exclusiveUsec))) {
+            if (!seenData) {
+                seenData = true;  // the header
+                continue;
+            }
+            error = path.str() + ":" + std::to_string(lineno) +
+                    ": expected name,calls,inclusive_usec[,exclusive_usec]";
+            return false;
+        }
+        if (numbers.size() == 2) {
+            entry.exclusiveUsec = entry.inclusiveUsec;
+        }
+        seenData = true;
+        add(std::move(entry));
+    }
+    return true;
+}
+
+void salt::ProfileReduction::add(ProfileEntry entry) {
+    const auto [it, inserted] = entryIndex.try_emplace(entry.name, entries.size());
+    if (inserted) {
+        entries.push_back(std::move(entry));
+        return;
+    }
+    ProfileEntry &sum = entries[it->second];
+    sum.calls += entry.calls;
+    sum.subrs += entry.subrs;
+    sum.exclusiveUsec += entry.exclusiveUsec;
+    sum.inclusiveUsec += entry.inclusiveUsec;
+}
+
+std::optional<size_t> salt::ProfileReduction::matchingRule(const ProfileEntry &entry) const {
+    for (size_t i = 0; i < rules.size(); ++i) {
+        if (rules[i].matches(entry)) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+std::list<std::string> salt::ProfileReduction::excludedRoutines() const {
+    std::list<std::string> routines;
+    llvm::StringSet<> seen;
+    for (const ProfileEntry &entry: entries) {
+        const llvm::StringRef name = routineName(entry.name);
+        if (!name.empty() && matchingRule(entry) && seen.insert(name).second) {
+            routines.push_back(name.str());
+        }
+    }
+    return routines;
+}
+
+void salt::ProfileReduction::write(llvm::raw_ostream &os) const {
+    std::vector<const ProfileEntry *> excluded;
+    llvm::StringSet<> seen;
+    for (const ProfileEntry &entry: entries) {
+        const llvm::StringRef name = routineName(entry.name);
+        if (!name.empty() && matchingRule(entry) && seen.insert(name).second) {
+            excluded.push_back(&entry);
+        }
+    }
+
+    os << "# SALT-FM profile reduction: " << excluded.size() << " of " << entries.size()
+            << " profiled routines excluded\n";
+    for (size_t i = 0; i < rules.size(); ++i) {
+        os << "# rule " << i + 1 << ": " << rules[i].text() << "\n";
+    }
+    os << "#          calls    usec/call cumusec/call  rule\n";
+    os << "BEGIN_EXCLUDE_LIST\n";
+    for (const ProfileEntry *entry: excluded) {
+        os << llvm::format("# %14.0f %12.3f %12.3f  %zu\n", entry->calls,
+                           perCall(entry->exclusiveUsec, entry->calls),
+                           perCall(entry->inclusiveUsec, entry->calls), *matchingRule(*entry) + 1);
+        os << "\"" << routineName(entry->name) << "\"\n";
+    }
+    os << "END_EXCLUDE_LIST\n";
+    os.flush();
+}
+
+bool salt::ProfileReduction::write(const llvm::StringRef path) const {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_Text);
+    if (ec) {
+        llvm::errs() << "ERROR: Could not open profile reduction " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    write(os);
+    return true;
+}
@@ -0,0 +1,519 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// salt-bench: generates C, C++ and Fortran sources of a configurable size and
+// measures how fast cparse-llvm and fparse-llvm instrument them.
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace {
+    enum class Language { C, CXX, Fortran };
+
+    enum class RunMode { Batch, PerFile };
+
+    llvm::cl::OptionCategory benchCategory("salt-bench options");
+
+    llvm::cl::list<Language> languages(
+        "lang", llvm::cl::desc("Languages to generate and instrument (default: all)"), llvm::cl::CommaSeparated,
+        llvm::cl::values(clEnumValN(Language::C, "c", "C sources, instrumented by cparse-llvm"),
+                         clEnumValN(Language::CXX, "cxx", "C++ sources, instrumented by cparse-llvm"),
+                         clEnumValN(Language::Fortran, "fortran", "Fortran sources, instrumented by fparse-llvm")),
+        llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<RunMode> runMode(
+        "mode", llvm::cl::desc("How the instrumentors are run"), llvm::cl::init(RunMode::Batch),
+        llvm::cl::values(clEnumValN(RunMode::Batch, "batch", "One --batch process per language"),
+                         clEnumValN(RunMode::PerFile, "per-file", "One process per source, as a build would")),
+        llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<std::string> outDir("out_dir", llvm::cl::desc("Directory the sources are generated in"),
+                                      llvm::cl::value_desc("dir"), llvm::cl::init("salt-bench"),
+                                      llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<unsigned> numFiles("files", llvm::cl::desc("Source files per language"),
+                                     llvm::cl::value_desc("N"), llvm::cl::init(50), llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<unsigned> numFunctions("functions", llvm::cl::desc("Functions (procedures) per file"),
+                                         llvm::cl::value_desc("N"), llvm::cl::init(100),
+                                         llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<unsigned> numReturns("returns", llvm::cl::desc("Return statements per function"),
+                                       llvm::cl::value_desc("N"), llvm::cl::init(4), llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<unsigned> templateDepth("template_depth",
+                                          llvm::cl::desc("Depth of the recursive template instantiated by "
+                                                         "every C++ file"),
+                                          llvm::cl::value_desc("N"), llvm::cl::init(64),
+                                          llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<unsigned> numInternal("internal", llvm::cl::desc("Internal procedures per Fortran procedure"),
+                                        llvm::cl::value_desc("N"), llvm::cl::init(1), llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<unsigned> numSelectEntries("select_entries",
+                                             llvm::cl::desc("Exclude list entries of the generated select "
+                                                            "file (0: run without a select file)"),
+                                             llvm::cl::value_desc("N"), llvm::cl::init(1000),
+                                             llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<unsigned> jobs("j", llvm::cl::desc("Passed to cparse-llvm in batch mode"),
+                                 llvm::cl::value_desc("N"), llvm::cl::init(1), llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<std::string> binDir("bin_dir",
+                                      llvm::cl::desc("Directory holding cparse-llvm and fparse-llvm "
+                                                     "(default: the directory of salt-bench)"),
+                                      llvm::cl::value_desc("dir"), llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<std::string> configFile("config_file",
+                                          llvm::cl::desc("Passed to the instrumentors (default: theirs)"),
+                                          llvm::cl::value_desc("filename"), llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<std::string> jsonFile("json", llvm::cl::desc("Also write the results as JSON to filename"),
+                                        llvm::cl::value_desc("filename"), llvm::cl::cat(benchCategory));
+
+    llvm::cl::opt<bool> generateOnly("generate_only", llvm::cl::desc("Generate the sources without running"),
+                                     llvm::cl::cat(benchCategory));
+
+    // What was generated for one language
+    struct Corpus {
+        Language language;
+        std::string dir;
+        // In the order they must be instrumented (Fortran modules before their users)
+        std::vector<std::string> sources;
+        unsigned functions{0};
+    };
+
+    // What one language's run measured
+    struct BenchResult {
+        const Corpus *corpus;
+        std::string tool;
+        int status{0};
+        double wallSeconds{0};
+        double cpuSeconds{0};
+        uint64_t peakRSSKiB{0};
+    };
+
+    llvm::StringRef languageName(const Language language) {
+        switch (language) {
+            case Language::C:
+                return "c";
+            case Language::CXX:
+                return "cxx";
+            case Language::Fortran:
+                return "fortran";
+        }
+        return "unknown";
+    }
+
+    bool openSource(const std::string &path, std::optional<llvm::raw_fd_ostream> &os) {
+        std::error_code ec;
+        os.emplace(path, ec, llvm::sys::fs::OF_Text);
+        if (ec) {
+            llvm::errs() << "ERROR: Could not write " << path << ": " << ec.message() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Early returns of a C or C++ function, followed by its final one
+    void writeCReturns(llvm::raw_ostream &os, const std::string &result) {
+        for (unsigned k = 1; k < numReturns; k++) {
+            os << "    if (x == " << k << ")\n    {\n        return " << k << ";\n    }\n";
+        }
+        os << "    return " << result << ";\n";
+    }
+
+    void writeCFile(llvm::raw_ostream &os, const unsigned file) {
+        os << "/* Generated by salt-bench */\n\n";
+        for (unsigned j = 0; j < numFunctions; j++) {
+            const std::string name = llvm::formatv("bench_c{0}_f{1}", file, j);
+            os << "int " << name << "(int x)\n{\n";
+            writeCReturns(os, j == 0 ? "x + 1" : llvm::formatv("x + bench_c{0}_f{1}(x / 2)", file, j - 1).str());
+            os << "}\n\n";
+        }
+        if (file == 0) {
+            os << "int main(void)\n{\n    return bench_c0_f0(1) == 0;\n}\n";
+        }
+    }
+
+    void writeCXXFile(llvm::raw_ostream &os, const unsigned file) {
+        os << "// Generated by salt-bench\n\n";
+        os << "namespace bench_cxx" << file << " {\n\n";
+        os << "template <int N>\nstruct Chain {\n    static int value(int x)\n    {\n"
+              "        if (x > N)\n        {\n            return Chain<N - 1>::value(x - 1);\n        }\n"
+              "        return x + N;\n    }\n};\n\n";
+        os << "template <>\nstruct Chain<0> {\n    static int value(int x)\n    {\n        return x;\n    }\n};\n\n";
+        os << "class Widget {\n  public:\n";
+        for (unsigned j = 0; j < numFunctions; j++) {
+            os << "    int f" << j << "(int x);\n";
+        }
+        os << "};\n\n";
+        for (unsigned j = 0; j < numFunctions; j++) {
+            os << "int Widget::f" << j << "(int x)\n{\n";
+            os << "    auto twice = [](int y) { return 2 * y; };\n";
+            if (j == 0) {
+                writeCReturns(os, llvm::formatv("twice(x) + Chain<{0}>::value(x)", templateDepth.getValue()));
+            } else {
+                writeCReturns(os, llvm::formatv("twice(x) + f{0}(x / 2)", j - 1));
+            }
+            os << "}\n\n";
+        }
+        os << "} // namespace bench_cxx" << file << "\n";
+        if (file == 0) {
+            os << "\nint main()\n{\n    bench_cxx0::Widget w;\n    return w.f0(1) == 0;\n}\n";
+        }
+    }
+
+    // Early returns of a Fortran procedure, alternating the one-line and block forms
+    void writeFortranReturns(llvm::raw_ostream &os) {
+        for (unsigned k = 1; k < numReturns; k++) {
+            if (k % 2 == 1) {
+                os << "    if (x == " << k << ") return\n";
+            } else {
+                os << "    if (x == " << k << ") then\n      r = " << k << "\n      return\n    end if\n";
+            }
+        }
+    }
+
+    void writeFortranModule(llvm::raw_ostream &os, const unsigned file) {
+        os << "! Generated by salt-bench\nmodule bench_m" << file << "\n  implicit none\ncontains\n";
+        for (unsigned j = 0; j < numFunctions; j++) {
+            const std::string name = llvm::formatv("bench_m{0}_p{1}", file, j);
+            const bool isFunction = j % 2 == 0;
+            if (isFunction) {
+                os << "  integer function " << name << "(x) result(r)\n";
+            } else {
+                os << "  subroutine " << name << "(x, r)\n";
+            }
+            os << "    integer, intent(in) :: x\n";
+            if (!isFunction) {
+                os << "    integer, intent(out) :: r\n";
+            }
+            os << "    r = x\n";
+            writeFortranReturns(os);
+            for (unsigned k = 0; k < numInternal; k++) {
+                os << "    r = r + " << name << "_h" << k << "(x)\n";
+            }
+            if (numInternal > 0) {
+                os << "  contains\n";
+                for (unsigned k = 0; k < numInternal; k++) {
+                    const std::string helper = llvm::formatv("{0}_h{1}", name, k);
+                    os << "    integer function " << helper << "(y)\n      integer, intent(in) :: y\n      "
+                       << helper << " = y + " << k << "\n    end function " << helper << "\n";
+                }
+            }
+            os << (isFunction ? "  end function " : "  end subroutine ") << name << "\n";
+        }
+        os << "end module bench_m" << file << "\n";
+    }
+
+    void writeFortranMain(llvm::raw_ostream &os) {
+        os << "! Generated by salt-bench\nprogram bench_main\n";
+        for (unsigned i = 0; i < numFiles; i++) {
+            os << "  use bench_m" << i << "\n";
+        }
+        os << "  implicit none\n  print *, bench_m0_p0(1)\nend program bench_main\n";
+    }
+
+    // Entries that never match, so every function is checked against the whole list
+    bool writeSelectFile(const std::string &path) {
+        std::optional<llvm::raw_fd_ostream> os;
+        if (!openSource(path, os)) {
+            return false;
+        }
+        *os << "# Generated by salt-bench\nBEGIN_EXCLUDE_LIST\n";
+        for (unsigned k = 0; k < numSelectEntries; k++) {
+            *os << "\"#bench_nomatch_" << k << "#\"\n";
+        }
+        *os << "END_EXCLUDE_LIST\n";
+        return true;
+    }
+
+    bool writeCompileCommands(const Corpus &corpus) {
+        llvm::json::Array commands;
+        for (const std::string &source : corpus.sources) {
+            commands.push_back(llvm::json::Object{
+                {"directory", corpus.dir},
+                {"arguments", llvm::json::Array{corpus.language == Language::C ? "cc" : "c++", "-c", source}},
+                {"file", source},
+            });
+        }
+        std::optional<llvm::raw_fd_ostream> os;
+        if (!openSource(corpus.dir + "/compile_commands.json", os)) {
+            return false;
+        }
+        *os << llvm::formatv("{0:2}", llvm::json::Value(std::move(commands))) << "\n";
+        return true;
+    }
+
+    bool writeSourceList(const Corpus &corpus) {
+        std::optional<llvm::raw_fd_ostream> os;
+        if (!openSource(corpus.dir + "/sources.txt", os)) {
+            return false;
+        }
+        for (const std::string &source : corpus.sources) {
+            *os << source << "\n";
+        }
+        return true;
+    }
+
+    std::optional<Corpus> generate(const Language language) {
+        Corpus corpus;
+        corpus.language = language;
+        corpus.dir = outDir + "/" + languageName(language).str();
+        if (std::error_code ec = llvm::sys::fs::create_directories(corpus.dir)) {
+            llvm::errs() << "ERROR: Could not create " << corpus.dir << ": " << ec.message() << "\n";
+            return std::nullopt;
+        }
+
+        for (unsigned i = 0; i < numFiles; i++) {
+            std::optional<llvm::raw_fd_ostream> os;
+            switch (language) {
+                case Language::C:
+                    corpus.sources.push_back(llvm::formatv("{0}/bench_c{1}.c", corpus.dir, i));
+                    if (!openSource(corpus.sources.back(), os)) {
+                        return std::nullopt;
+                    }
+                    writeCFile(*os, i);
+                    corpus.functions += numFunctions + (i == 0 ? 1 : 0);
+                    break;
+                case Language::CXX:
+                    corpus.sources.push_back(llvm::formatv("{0}/bench_cxx{1}.cpp", corpus.dir, i));
+                    if (!openSource(corpus.sources.back(), os)) {
+                        return std::nullopt;
+                    }
+                    writeCXXFile(*os, i);
+                    // The methods, their lambdas and both Chain definitions
+                    corpus.functions += 2 * numFunctions + 2 + (i == 0 ? 1 : 0);
+                    break;
+                case Language::Fortran:
+                    corpus.sources.push_back(llvm::formatv("{0}/bench_m{1}.f90", corpus.dir, i));
+                    if (!openSource(corpus.sources.back(), os)) {
+                        return std::nullopt;
+                    }
+                    writeFortranModule(*os, i);
+                    corpus.functions += numFunctions * (1 + numInternal);
+                    break;
+            }
+        }
+
+        if (language == Language::Fortran) {
+            corpus.sources.push_back(corpus.dir + "/bench_main.f90");
+            std::optional<llvm::raw_fd_ostream> os;
+            if (!openSource(corpus.sources.back(), os)) {
+                return std::nullopt;
+            }
+            writeFortranMain(*os);
+            corpus.functions += 1;
+            if (!writeSourceList(corpus)) {
+                return std::nullopt;
+            }
+        } else if (!writeCompileCommands(corpus)) {
+            return std::nullopt;
+        }
+        return corpus;
+    }
+
+    std::string instrumentedName(llvm::StringRef source) {
+        llvm::SmallString<256> name = source;
+        std::string extension = llvm::sys::path::extension(source).str();
+        if (extension == ".f90") {
+            // fparse-llvm capitalizes the extension of its outputs
+            extension = ".F90";
+        }
+        llvm::sys::path::replace_extension(name, ".inst" + extension);
+        return name.str().str();
+    }
+
+    // Runs one instrumentor command with its output sent to log, adding to result
+    bool runTool(const std::string &tool, std::vector<std::string> args, const std::string &log,
+                 BenchResult &result) {
+        args.insert(args.begin(), tool);
+        if (!configFile.empty()) {
+            args.push_back("--config_file=" + configFile);
+        }
+        if (numSelectEntries > 0) {
+            args.push_back("--tau_select_file=" + outDir + "/select.tau");
+        }
+        std::vector<llvm::StringRef> argRefs(args.begin(), args.end());
+        const std::optional<llvm::StringRef> redirects[] = {std::nullopt, llvm::StringRef(log),
+                                                             llvm::StringRef(log)};
+
+        std::string error;
+        std::optional<llvm::sys::ProcessStatistics> stats;
+        const auto start = std::chrono::steady_clock::now();
+        const int status = llvm::sys::ExecuteAndWait(tool, argRefs, std::nullopt, redirects, 0, 0, &error,
+                                                     nullptr, &stats);
+        result.wallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (stats) {
+            result.cpuSeconds += std::chrono::duration<double>(stats->TotalTime).count();
+            result.peakRSSKiB = std::max(result.peakRSSKiB, stats->PeakMemory);
+        }
+        if (status != 0) {
+            llvm::errs() << "ERROR: " << tool << " exited with status " << status
+                         << (error.empty() ? "" : ": " + error) << ", see " << log << "\n";
+            result.status = status;
+            return false;
+        }
+        return true;
+    }
+
+    BenchResult run(const Corpus &corpus) {
+        BenchResult result{&corpus};
+        const bool fortran = corpus.language == Language::Fortran;
+        result.tool = fortran ? "fparse-llvm" : "cparse-llvm";
+        const std::string tool = binDir + "/" + result.tool;
+        const std::string log = corpus.dir + "/" + result.tool + ".log";
+
+        // Fortran module files are written to the working directory
+        llvm::SmallString<256> savedDir;
+        llvm::sys::fs::current_path(savedDir);
+        llvm::sys::fs::set_current_path(corpus.dir);
+
+        if (runMode == RunMode::Batch) {
+            std::vector<std::string> args{"--batch=" + (fortran ? corpus.dir + "/sources.txt" : corpus.dir)};
+            if (!fortran) {
+                args.push_back("-j=" + std::to_string(jobs));
+            }
+            runTool(tool, args, log, result);
+        } else {
+            for (const std::string &source : corpus.sources) {
+                if (!runTool(tool, {source, "--tau_output=" + instrumentedName(source)}, log, result)) {
+                    break;
+                }
+            }
+        }
+
+        llvm::sys::fs::set_current_path(savedDir);
+        return result;
+    }
+
+    void printResults(llvm::raw_ostream &os, const std::vector<BenchResult> &results) {
+        os << "SALT-FM benchmark (" << (runMode == RunMode::Batch ? "batch" : "per-file") << ", "
+           << numFiles << " files x " << numFunctions << " functions, " << numSelectEntries
+           << " select entries)\n";
+        os << "lang     tool           files  functions     wall s    files/s  functions/s  peak RSS MiB  status\n";
+        for (const BenchResult &result : results) {
+            const size_t files = result.corpus->sources.size();
+            const double wall = result.wallSeconds > 0 ? result.wallSeconds : 1e-9;
+            os << llvm::format("%-8s %-12s %7zu %10u %10.3f %10.1f %12.1f %13.1f  %6d\n",
+                               languageName(result.corpus->language).str().c_str(), result.tool.c_str(), files,
+                               result.corpus->functions, result.wallSeconds, files / wall,
+                               result.corpus->functions / wall, result.peakRSSKiB / 1024.0, result.status);
+        }
+    }
+
+    bool writeResults(const std::string &path, const std::vector<BenchResult> &results) {
+        llvm::json::Array entries;
+        for (const BenchResult &result : results) {
+            const size_t files = result.corpus->sources.size();
+            const double wall = result.wallSeconds > 0 ? result.wallSeconds : 1e-9;
+            entries.push_back(llvm::json::Object{
+                {"lang", languageName(result.corpus->language)},
+                {"tool", result.tool},
+                {"mode", runMode == RunMode::Batch ? "batch" : "per-file"},
+                {"files", static_cast<int64_t>(files)},
+                {"functions", result.corpus->functions},
+                {"wall_seconds", result.wallSeconds},
+                {"cpu_seconds", result.cpuSeconds},
+                {"files_per_second", files / wall},
+                {"functions_per_second", result.corpus->functions / wall},
+                {"peak_rss_kib", static_cast<int64_t>(result.peakRSSKiB)},
+                {"status", result.status},
+            });
+        }
+        std::error_code ec;
+        llvm::raw_fd_ostream os(path, ec);
+        if (ec) {
+            llvm::errs() << "ERROR: Could not open " << path << ": " << ec.message() << "\n";
+            return false;
+        }
+        os << llvm::formatv("{0:2}", llvm::json::Value(llvm::json::Object{{"results", std::move(entries)}}))
+           << "\n";
+        return true;
+    }
+
+    // Paths are handed to tools run from other directories
+    std::string absolutePath(llvm::StringRef path) {
+        llvm::SmallString<256> absolute = path;
+        llvm::sys::fs::make_absolute(absolute);
+        return absolute.str().str();
+    }
+}
+
+int main(int argc, const char **argv) {
+    llvm::cl::HideUnrelatedOptions(benchCategory);
+    llvm::cl::ParseCommandLineOptions(argc, argv,
+                                      "Generate synthetic sources and measure the throughput of the SALT-FM "
+                                      "instrumentors\n");
+
+    if (languages.empty()) {
+        languages.push_back(Language::C);
+        languages.push_back(Language::CXX);
+        languages.push_back(Language::Fortran);
+    }
+    if (binDir.empty()) {
+        static int anchor;
+        binDir = llvm::sys::path::parent_path(llvm::sys::fs::getMainExecutable(argv[0], &anchor)).str();
+    }
+    outDir = absolutePath(outDir);
+    if (!configFile.empty()) {
+        configFile = absolutePath(configFile);
+    }
+
+    std::vector<Corpus> corpora;
+    for (const Language language : languages) {
+        std::optional<Corpus> corpus = generate(language);
+        if (!corpus) {
+            return 1;
+        }
+        corpora.push_back(std::move(*corpus));
+    }
+    if (numSelectEntries > 0 && !writeSelectFile(outDir + "/select.tau")) {
+        return 1;
+    }
+    if (generateOnly) {
+        llvm::outs() << "Generated sources in " << outDir << "\n";
+        return 0;
+    }
+
+    std::vector<BenchResult> results;
+    int status = 0;
+    for (const Corpus &corpus : corpora) {
+        results.push_back(run(corpus));
+        if (results.back().status != 0) {
+            status = 1;
+        }
+    }
+
+    printResults(llvm::outs(), results);
+    if (!jsonFile.empty() && !writeResults(jsonFile, results)) {
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,157 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+/* The salt-enable library, see salt_enable.h. Tables are pushed onto a
+ * lock-free list, and bits are changed with atomic read-modify-writes, so
+ * tables can be registered and switched from any thread. The probes read
+ * the bits with relaxed atomic loads (SALT_ENABLE_LOAD): a change reaches a
+ * function at one of its next calls, and never between its begin and end
+ * probes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "salt_enable.h"
+
+static salt_enable_table *salt_enable_tables;
+
+/* Whether name matches the pattern [pattern, end) as a whole */
+static int salt_enable_match(const char *pattern, const char *end, const char *name)
+{
+    /* Where to resume after the last '*': its pattern position and name position */
+    const char *star = NULL;
+    const char *retry = NULL;
+    while (*name != '\0')
+    {
+        if (pattern != end && *pattern == '*')
+        {
+            star = ++pattern;
+            retry = name;
+        }
+        else if (pattern != end && (*pattern == '?' || *pattern == *name))
+        {
+            pattern++;
+            name++;
+        }
+        else if (star != NULL)
+        {
+            pattern = star;
+            name = ++retry;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    while (pattern != end && *pattern == '*')
+    {
+        pattern++;
+    }
+    return pattern == end;
+}
+
+static unsigned salt_enable_set_table(salt_enable_table *table, const char *pattern, const char *end,
+                                      int enabled)
+{
+    unsigned matched = 0;
+    for (unsigned i = 0; i < table->count; i++)
+    {
+        if (!salt_enable_match(pattern, end, table->names[i]))
+        {
+            continue;
+        }
+        unsigned char mask = (unsigned char)(1u << (i % 8));
+        if (enabled)
+        {
+            __atomic_fetch_or(&table->bits[i / 8], mask, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            __atomic_fetch_and(&table->bits[i / 8], (unsigned char)~mask, __ATOMIC_RELAXED);
+        }
+        matched++;
+    }
+    return matched;
+}
+
+/* Applies spec to table, or to every registered table if table is null */
+static unsigned salt_enable_apply_to(salt_enable_table *table, const char *spec)
+{
+    unsigned matched = 0;
+    while (*spec != '\0')
+    {
+        const char *end = strchr(spec, ';');
+        if (end == NULL)
+        {
+            end = spec + strlen(spec);
+        }
+        int enabled = 1;
+        const char *pattern = spec;
+        if (pattern != end && (*pattern == '-' || *pattern == '+'))
+        {
+            enabled = *pattern == '+';
+            pattern++;
+        }
+        if (pattern != end)
+        {
+            if (table != NULL)
+            {
+                matched += salt_enable_set_table(table, pattern, end, enabled);
+            }
+            else
+            {
+                for (salt_enable_table *t = __atomic_load_n(&salt_enable_tables, __ATOMIC_ACQUIRE); t != NULL;
+                     t = t->next)
+                {
+                    matched += salt_enable_set_table(t, pattern, end, enabled);
+                }
+            }
+        }
+        spec = *end == ';' ? end + 1 : end;
+    }
+    return matched;
+}
+
+void salt_enable_register(salt_enable_table *table)
+{
+    const char *spec = getenv("SALT_ENABLE");
+    if (spec != NULL)
+    {
+        salt_enable_apply_to(table, spec);
+    }
+    table->next = __atomic_load_n(&salt_enable_tables, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&salt_enable_tables, &table->next, table, 1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+    {
+    }
+}
+
+unsigned salt_enable_set(const char *pattern, int enabled)
+{
+    unsigned matched = 0;
+    const char *end = pattern + strlen(pattern);
+    for (salt_enable_table *t = __atomic_load_n(&salt_enable_tables, __ATOMIC_ACQUIRE); t != NULL; t = t->next)
+    {
+        matched += salt_enable_set_table(t, pattern, end, enabled);
+    }
+    return matched;
+}
+
+unsigned salt_enable_apply(const char *spec)
+{
+    return salt_enable_apply_to(NULL, spec);
+}
@@ -0,0 +1,123 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "select_matcher.hpp"
+
+#include "llvm/ADT/SmallVector.h"
+
+namespace {
+    constexpr const char *whitespace = " \t\n\r\f\v";
+
+    // Whole-string match of subject against pieces, which were separated by a
+    // wildcard matching any (possibly empty) run of characters. Anchoring the
+    // first and last piece and placing the middle pieces at their leftmost
+    // occurrence is exact for this pattern language, so no backtracking is needed.
+    bool matchPieces(llvm::StringRef subject, const std::vector<std::string> &pieces) {
+        const llvm::StringRef first{pieces.front()};
+        const llvm::StringRef last{pieces.back()};
+        if (subject.size() < first.size() + last.size() || !subject.starts_with(first) ||
+            !subject.ends_with(last)) {
+            return false;
+        }
+        llvm::StringRef middle = subject.drop_front(first.size()).drop_back(last.size());
+        for (size_t i = 1; i + 1 < pieces.size(); ++i) {
+            const size_t pos = middle.find(pieces[i]);
+            if (pos == llvm::StringRef::npos) {
+                return false;
+            }
+            middle = middle.drop_front(pos + pieces[i].size());
+        }
+        return true;
+    }
+}
+
+void salt::SelectMatcher::WildcardIndex::insert(llvm::StringRef pattern, const char wildcard) {
+    llvm::SmallVector<llvm::StringRef, 4> split;
+    pattern.split(split, wildcard);
+    std::vector<std::string> pieces(split.begin(), split.end());
+    prefixLengths.insert(pieces.front().size());
+    byPrefix[pieces.front()].push_back(std::move(pieces));
+}
+
+bool salt::SelectMatcher::WildcardIndex::matches(llvm::StringRef subject) const {
+    for (const size_t length: prefixLengths) {
+        if (length > subject.size()) {
+            break;
+        }
+        const auto bucket = byPrefix.find(subject.substr(0, length).str());
+        if (bucket == byPrefix.end()) {
+            continue;
+        }
+        for (const auto &pieces: bucket->second) {
+            if (matchPieces(subject, pieces)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+salt::SelectMatcher::SelectMatcher(const std::list<std::string> &patterns, const Kind kind) {
+    const char wildcard = kind == Kind::Routine ? '#' : '*';
+    for (const auto &entry: patterns) {
+        const llvm::StringRef pattern = llvm::StringRef(entry).trim(whitespace);
+        if (pattern.empty()) {
+            continue;
+        }
+        isEmpty = false;
+
+        const bool anyDirectory = kind == Kind::File && !pattern.contains('/');
+        if (!pattern.contains(wildcard)) {
+            (anyDirectory ? exactFileNames : exact).insert(pattern.str());
+        } else {
+            (anyDirectory ? fileNameWildcards : wildcards).insert(pattern, wildcard);
+        }
+    }
+}
+
+bool salt::SelectMatcher::matches(llvm::StringRef subject) const {
+    if (isEmpty) {
+        return false;
+    }
+    subject = subject.trim(whitespace);
+    if (!exact.empty() && exact.count(subject.str()) != 0) {
+        return true;
+    }
+    if (!exactFileNames.empty()) {
+        const size_t slash = subject.find_last_of('/');
+        const llvm::StringRef fileName = slash == llvm::StringRef::npos ? subject : subject.substr(slash + 1);
+        if (exactFileNames.count(fileName.str()) != 0) {
+            return true;
+        }
+    }
+    if (!wildcards.empty() && wildcards.matches(subject)) {
+        return true;
+    }
+    if (!fileNameWildcards.empty()) {
+        // A glob may itself span directories, so try the whole path and the
+        // remainder after every '/'
+        for (llvm::StringRef rest = subject;;) {
+            if (fileNameWildcards.matches(rest)) {
+                return true;
+            }
+            const size_t slash = rest.find('/');
+            if (slash == llvm::StringRef::npos) {
+                break;
+            }
+            rest = rest.drop_front(slash + 1);
+        }
+    }
+    return false;
+}
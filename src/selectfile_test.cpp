@@ -1,67 +1,178 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Checks salt::SelectMatcher and the select file lists it is built from.
+// Exits non-zero after printing every expectation that does not hold.
+
+#include <cstdio>
+#include <fstream>
+#include <list>
 #include <string>
-#include "instrumentor.hpp"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+#include "select_matcher.hpp"
 #include "selectfile.hpp"
 
-std::vector<inst_loc*> inst_locations;
-
-const char* loc_typ_strs[NUM_LOC_TYPES] =
-  {
-    "begin func",
-    "return",
-    "multiline return",
-    "exit"
-  };
-
-void dump_inst_loc(inst_loc* loc) {
-  printf("\tLine:         %d\n", loc->line);
-  printf("\tCol:          %d\n", loc->col);
-  printf("\tKind:         %s\n", loc_typ_strs[loc->kind]);
-  printf("\tRet type:     %s\n", loc->return_type);
-  printf("\tName:         %s\n", loc->func_name);
-  printf("\tTau:          %s\n", loc->full_tau_name);
-  printf("\tHas args:     %s\n", loc->has_args ? "Yes" : "No");
-  printf("\tIs ret ptr:   %s\n", loc->is_return_ptr ? "Yes" : "No");
-  printf("\tNeeds move:   %s\n", loc->needs_move ? "Yes" : "No");
-}
+namespace {
+    int failures = 0;
 
-void dump_inst_loc(inst_loc* loc, int n) {
-  printf("location %d\n", n);
-  dump_inst_loc(loc);
-}
+    void expect(const salt::SelectMatcher &matcher, const char *list, const char *subject, const bool expected) {
+        if (matcher.matches(subject) != expected) {
+            std::fprintf(stderr, "FAIL: %s %s \"%s\"\n", list, expected ? "does not match" : "matches", subject);
+            failures++;
+        }
+    }
 
-void dump_inst_loc(inst_loc* loc, int n, bool (*filter)(inst_loc*)) {
-  if (filter(loc)) {
-    printf("location %d\n", n);
-    dump_inst_loc(loc);
-  }
-}
+    salt::SelectMatcher routines(const std::list<std::string> &patterns) {
+        return salt::SelectMatcher(patterns, salt::SelectMatcher::Kind::Routine);
+    }
 
-void dump_all_locs() {
-  for (int i = 0; i < inst_locations.size(); i++) {
-    dump_inst_loc(inst_locations[i], i);
-  }
-}
+    salt::SelectMatcher files(const std::list<std::string> &patterns) {
+        return salt::SelectMatcher(patterns, salt::SelectMatcher::Kind::File);
+    }
 
-void dump_all_locs(bool (*filter)(inst_loc*)) {
-  for (int i = 0; i < inst_locations.size(); i++) {
-    dump_inst_loc(inst_locations[i], i, filter);
-  }
-}
+    void testExactNames() {
+        const auto matcher = routines({"int foo(int)", "void bar()"});
+        expect(matcher, "exact", "int foo(int)", true);
+        expect(matcher, "exact", "void bar()", true);
+        expect(matcher, "exact", "int foo(int, int)", false);
+        expect(matcher, "exact", "int foo2(int)", false);
+        expect(matcher, "exact", "int fo", false);
+        expect(routines({}), "empty", "int foo(int)", false);
 
-int main(int argc, const char** argv) {
+        const auto exactFiles = files({"src/a.c", "b.c"});
+        expect(exactFiles, "exact file", "src/a.c", true);
+        expect(exactFiles, "exact file", "/home/src/a.c", false);
+        expect(exactFiles, "exact file", "/home/lib/b.c", true);
+        expect(exactFiles, "exact file", "/home/lib/ab.c", false);
+    }
 
-  std::string selectfile;
-  if (argc > 1){
-    selectfile = std::string(argv[1]);
-  }
-  else {
-    printf("no args\n");
-    return 0;
-  }
+    void testRoutineWildcard() {
+        const auto matcher = routines({"#foo#", "int #(double)", "long bar#baz(long)"});
+        expect(matcher, "'#'", "int foo(int)", true);
+        expect(matcher, "'#'", "void ns::foo()", true);
+        expect(matcher, "'#'", "foo", true);
+        expect(matcher, "'#'", "int sqr(double)", true);
+        expect(matcher, "'#'", "int sqr(float)", false);
+        expect(matcher, "'#'", "long bar_to_baz(long)", true);
+        expect(matcher, "'#'", "long barbaz(long)", true);
+        expect(matcher, "'#'", "long baz_bar(long)", false);
+        expect(matcher, "'#'", "void fo()", false);
+        expect(routines({"#"}), "'#' alone", "void anything(int *)", true);
+
+        // '*' is part of a C/C++ type, not a wildcard
+        const auto pointers = routines({"int *first(int *)", "char *#"});
+        expect(pointers, "'*' routine", "int *first(int *)", true);
+        expect(pointers, "'*' routine", "int first(int)", false);
+        expect(pointers, "'*' routine", "int **first(int *)", false);
+        expect(pointers, "'*' routine", "char *name()", true);
+        expect(pointers, "'*' routine", "char name()", false);
+    }
+
+    void testFileWildcard() {
+        const auto names = files({"*.c"});
+        expect(names, "'*' file", "x.c", true);
+        expect(names, "'*' file", "/home/src/x.c", true);
+        expect(names, "'*' file", "/home/src/x.cpp", false);
+        expect(names, "'*' file", "/home/x.c/y.h", false);
+
+        const auto paths = files({"*/src/*.c"});
+        expect(paths, "'*' path", "/home/src/x.c", true);
+        expect(paths, "'*' path", "/home/lib/x.c", false);
+        expect(paths, "'*' path", "src/x.c", false);
+
+        // '#' is an ordinary character in a file pattern
+        const auto hash = files({"#x.c"});
+        expect(hash, "'#' file", "/home/#x.c", true);
+        expect(hash, "'#' file", "/home/ax.c", false);
+    }
+
+    void testLiteralDot() {
+        const auto names = files({"a.c", "*.f90"});
+        expect(names, "'.'", "/home/a.c", true);
+        expect(names, "'.'", "/home/abc", false);
+        expect(names, "'.'", "/home/x.f90", true);
+        expect(names, "'.'", "/home/xf90", false);
+        expect(names, "'.'", "/home/x_f90", false);
 
-  if (!selectfile.empty()) {
-    processInstrumentationRequests(selectfile.c_str());
-  }
+        const auto members = routines({"#.operator#"});
+        expect(members, "'.' routine", "void s.operator()()", true);
+        expect(members, "'.' routine", "void s_operator()", false);
+    }
 
-  dump_all_locs();
+    void testWhitespace() {
+        const auto matcher = routines({"  int foo(int)\t", " #bar# "});
+        expect(matcher, "whitespace", "int foo(int)", true);
+        expect(matcher, "whitespace", " int foo(int) \n", true);
+        expect(matcher, "whitespace", "void bar()", true);
+        expect(matcher, "whitespace", "int  foo(int)", false);
+        expect(routines({"   ", ""}), "blank", "", false);
+
+        const auto fileNames = files({" a.c ", "\t*.h"});
+        expect(fileNames, "whitespace file", "/home/a.c", true);
+        expect(fileNames, "whitespace file", "/home/x.h", true);
+    }
+
+    // The lists of a select file keep what surrounds an entry, and the
+    // matchers built from them ignore it
+    void testSelectFile() {
+        llvm::SmallString<128> path;
+        if (llvm::sys::fs::createTemporaryFile("selectfile_test", "tau", path)) {
+            std::fprintf(stderr, "FAIL: cannot create a select file\n");
+            failures++;
+            return;
+        }
+        {
+            std::ofstream select(path.c_str());
+            select << "BEGIN_EXCLUDE_LIST\n"
+                   << "   int skipped(int)   \n"
+                   << "\t\"#leaf#\"\n"
+                   << "END_EXCLUDE_LIST\n"
+                   << "BEGIN_FILE_INCLUDE_LIST\n"
+                   << "  *.c  \n"
+                   << "END_FILE_INCLUDE_LIST\n";
+        }
+        resetInstrumentationRequests();
+        if (!processInstrumentationRequests(path.c_str())) {
+            std::fprintf(stderr, "FAIL: cannot read %s\n", path.c_str());
+            failures++;
+        }
+        llvm::sys::fs::remove(path);
+
+        expect(excludematcher, "select file", "int skipped(int)", true);
+        expect(excludematcher, "select file", "long leaf_sum(long)", true);
+        expect(excludematcher, "select file", "int kept(int)", false);
+        expect(fileincludematcher, "select file", "/home/src/x.c", true);
+        expect(fileincludematcher, "select file", "/home/src/x.cc", false);
+        resetInstrumentationRequests();
+    }
+}
+
+int main() {
+    testExactNames();
+    testRoutineWildcard();
+    testFileWildcard();
+    testLiteralDot();
+    testWhitespace();
+    testSelectFile();
+    if (failures != 0) {
+        std::fprintf(stderr, "%d expectation(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All select file expectations hold\n");
+    return 0;
 }
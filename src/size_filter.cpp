@@ -0,0 +1,111 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "size_filter.hpp"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
+bool salt::SizeThresholds::tooSmall(const FunctionSize &size) const {
+    return size.statements < minStatements || size.nodes < minNodes || size.lines < minLines ||
+           (skipLeaf && !size.hasLoop && !size.hasCall);
+}
+
+salt::FunctionGroup salt::GroupClassifier::classify(const bool isMain, const FunctionSize &size,
+                                                    const bool called) const {
+    if (isMain) {
+        return FunctionGroup::Main;
+    }
+    if (size.statements < smallStatements) {
+        return FunctionGroup::Small;
+    }
+    if (!size.hasCall) {
+        return FunctionGroup::Leaf;
+    }
+    return called ? FunctionGroup::Interior : FunctionGroup::TopLevel;
+}
+
+llvm::StringRef salt::groupMacro(const FunctionGroup group) {
+    switch (group) {
+        case FunctionGroup::Main:
+            return "SALT_GROUP_MAIN";
+        case FunctionGroup::Small:
+            return "SALT_GROUP_SMALL";
+        case FunctionGroup::Leaf:
+            return "SALT_GROUP_LEAF";
+        case FunctionGroup::TopLevel:
+            return "SALT_GROUP_TOP";
+        case FunctionGroup::Interior:
+            return "SALT_GROUP_INTERIOR";
+    }
+    return "SALT_GROUP_ALL";
+}
+
+llvm::StringRef salt::groupPrelude() {
+    return "#ifndef SALT_GROUP_ALL\n"
+           "#define SALT_GROUP_ALL 1\n"
+           "#endif\n"
+           "#ifndef SALT_GROUP_MAIN\n"
+           "#define SALT_GROUP_MAIN SALT_GROUP_ALL\n"
+           "#endif\n"
+           "#ifndef SALT_GROUP_SMALL\n"
+           "#define SALT_GROUP_SMALL SALT_GROUP_ALL\n"
+           "#endif\n"
+           "#ifndef SALT_GROUP_LEAF\n"
+           "#define SALT_GROUP_LEAF SALT_GROUP_ALL\n"
+           "#endif\n"
+           "#ifndef SALT_GROUP_TOP\n"
+           "#define SALT_GROUP_TOP SALT_GROUP_ALL\n"
+           "#endif\n"
+           "#ifndef SALT_GROUP_INTERIOR\n"
+           "#define SALT_GROUP_INTERIOR SALT_GROUP_ALL\n"
+           "#endif\n";
+}
+
+void salt::SizeReport::add(SkippedFunction function) {
+    std::lock_guard<std::mutex> lock(mutex);
+    functions.push_back(std::move(function));
+}
+
+void salt::SizeReport::write(llvm::raw_ostream &os, const SizeThresholds &thresholds) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    os << "# SALT-FM size report: " << functions.size() << " functions not instrumented for their size\n";
+    os << "# thresholds: statements >= " << thresholds.minStatements << ", nodes >= " << thresholds.minNodes
+            << ", lines >= " << thresholds.minLines << (thresholds.skipLeaf ? ", has a loop or a call" : "")
+            << "\n";
+    os << "#  stmts  nodes  lines  loop  call  location\n";
+    os << "BEGIN_EXCLUDE_LIST\n";
+    for (const SkippedFunction &function: functions) {
+        os << llvm::format("# %6u %6u %6u  %-4s  %-4s  ", function.size.statements, function.size.nodes,
+                           function.size.lines, function.size.hasLoop ? "yes" : "no",
+                           function.size.hasCall ? "yes" : "no")
+                << function.file << ":" << function.line << "\n";
+        os << "\"" << function.name << "\"\n";
+    }
+    os << "END_EXCLUDE_LIST\n";
+    os.flush();
+}
+
+bool salt::SizeReport::write(const llvm::StringRef path, const SizeThresholds &thresholds) const {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_Text);
+    if (ec) {
+        llvm::errs() << "ERROR: Could not open size report " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    write(os, thresholds);
+    return true;
+}
@@ -0,0 +1,65 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "snippet_template.hpp"
+
+#include <algorithm>
+
+salt::SnippetTemplate::SnippetTemplate(llvm::StringRef text, llvm::ArrayRef<llvm::StringRef> placeholders) {
+    std::string literal;
+    while (!text.empty()) {
+        const size_t open = text.find("${");
+        const size_t close = open == llvm::StringRef::npos ? llvm::StringRef::npos : text.find('}', open);
+        if (close == llvm::StringRef::npos) {
+            literal += text.str();
+            break;
+        }
+        const llvm::StringRef name = text.slice(open + 2, close);
+        const auto known = std::find(placeholders.begin(), placeholders.end(), name);
+        literal += text.take_front(open).str();
+        if (known == placeholders.end()) {
+            literal += text.slice(open, close + 1).str();
+        } else {
+            literalSize += literal.size();
+            segments.push_back({std::move(literal), static_cast<size_t>(known - placeholders.begin())});
+            literal.clear();
+        }
+        text = text.drop_front(close + 1);
+    }
+    literalSize += literal.size();
+    segments.push_back({std::move(literal), noSlot});
+}
+
+void salt::SnippetTemplate::expand(std::string &out, llvm::ArrayRef<llvm::StringRef> values) const {
+    size_t size = out.size() + literalSize;
+    for (const Segment &segment: segments) {
+        if (segment.slot < values.size()) {
+            size += values[segment.slot].size();
+        }
+    }
+    out.reserve(size);
+    for (const Segment &segment: segments) {
+        out += segment.literal;
+        if (segment.slot < values.size()) {
+            out.append(values[segment.slot].data(), values[segment.slot].size());
+        }
+    }
+}
+
+std::string salt::SnippetTemplate::str(llvm::ArrayRef<llvm::StringRef> values) const {
+    std::string out;
+    expand(out, values);
+    return out;
+}
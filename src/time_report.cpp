@@ -0,0 +1,153 @@
+/* Copyright (C) 2025, ParaTools, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "time_report.hpp"
+
+#include <ctime>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+
+salt::PhaseTime &salt::PhaseTime::operator+=(const PhaseTime &other) {
+    wall += other.wall;
+    cpu += other.cpu;
+    return *this;
+}
+
+salt::PhaseTime &salt::PhaseTime::operator-=(const PhaseTime &other) {
+    wall -= other.wall;
+    cpu -= other.cpu;
+    return *this;
+}
+
+llvm::StringRef salt::phaseName(const Phase phase) {
+    switch (phase) {
+        case Phase::Config:
+            return "config";
+        case Phase::Parse:
+            return "parse";
+        case Phase::Visit:
+            return "visit";
+        case Phase::Select:
+            return "select";
+        case Phase::Rewrite:
+            return "rewrite";
+    }
+    return "unknown";
+}
+
+salt::TimeStamp salt::TimeStamp::now() {
+    TimeStamp stamp;
+    stamp.wall = std::chrono::steady_clock::now();
+    timespec cpu{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu) == 0) {
+        stamp.cpu = static_cast<double>(cpu.tv_sec) + static_cast<double>(cpu.tv_nsec) * 1e-9;
+    }
+    return stamp;
+}
+
+salt::PhaseTime salt::operator-(const TimeStamp &end, const TimeStamp &start) {
+    return {std::chrono::duration<double>(end.wall - start.wall).count(), end.cpu - start.cpu};
+}
+
+salt::PhaseTimer::PhaseTimer(FileTiming *timing, const Phase phase) : timing(timing), phase(phase) {
+    if (timing != nullptr) {
+        start = TimeStamp::now();
+    }
+}
+
+void salt::PhaseTimer::stop() {
+    if (timing != nullptr) {
+        (*timing)[phase] += TimeStamp::now() - start;
+        timing = nullptr;
+    }
+}
+
+void salt::TimeReport::add(FileTiming timing) {
+    std::lock_guard<std::mutex> lock(mutex);
+    files.push_back(std::move(timing));
+}
+
+namespace {
+    void printRow(llvm::raw_ostream &os, const salt::FileTiming &timing) {
+        salt::PhaseTime total;
+        for (const salt::PhaseTime &time: timing.phases) {
+            os << llvm::format(" %7.3f/%-7.3f", time.wall, time.cpu);
+            total += time;
+        }
+        os << llvm::format(" %7.3f/%-7.3f %6u %6u  ", total.wall, total.cpu, timing.functionsVisited,
+                           timing.functionsInstrumented)
+                << timing.file << "\n";
+    }
+
+    llvm::json::Object phaseJSON(const salt::FileTiming &timing) {
+        llvm::json::Object phases;
+        for (size_t i = 0; i < salt::numPhases; i++) {
+            phases[salt::phaseName(static_cast<salt::Phase>(i))] =
+                    llvm::json::Object{{"wall", timing.phases[i].wall}, {"cpu", timing.phases[i].cpu}};
+        }
+        return phases;
+    }
+}
+
+void salt::TimeReport::print(llvm::raw_ostream &os) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    FileTiming total;
+    total.file = "Total";
+    for (const FileTiming &timing: files) {
+        for (size_t i = 0; i < numPhases; i++) {
+            total.phases[i] += timing.phases[i];
+        }
+        total.functionsVisited += timing.functionsVisited;
+        total.functionsInstrumented += timing.functionsInstrumented;
+    }
+
+    os << "===" << std::string(73, '-') << "===\n";
+    os << "                       SALT-FM time report (wall/CPU seconds)\n";
+    os << "===" << std::string(73, '-') << "===\n";
+    for (size_t i = 0; i < numPhases; i++) {
+        os << llvm::format("   %-13s", phaseName(static_cast<Phase>(i)).str().c_str());
+    }
+    os << "   total          funcs   inst  file\n";
+    for (const FileTiming &timing: files) {
+        printRow(os, timing);
+    }
+    printRow(os, total);
+    os.flush();
+}
+
+bool salt::TimeReport::writeJSON(const llvm::StringRef path) const {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_Text);
+    if (ec) {
+        llvm::errs() << "ERROR: Could not open time report " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    llvm::json::Array entries;
+    for (const FileTiming &timing: files) {
+        entries.push_back(llvm::json::Object{
+            {"file", timing.file},
+            {"phases", phaseJSON(timing)},
+            {"functions_visited", timing.functionsVisited},
+            {"functions_instrumented", timing.functionsInstrumented},
+        });
+    }
+    os << llvm::formatv("{0:2}", llvm::json::Value(llvm::json::Object{{"files", std::move(entries)}})) << "\n";
+    return true;
+}
@@ -0,0 +1,134 @@
+# Runs the probe-bench executables and prints the overhead of each backend.
+#
+#   cmake -DBASELINE=<probe-base>
+#         -DVARIANTS=<name>:<stub|real>:<executable>[|<VAR>=<value>],...
+#         [-DJSON=<file>] -P probe_bench_report.cmake
+#
+# Every executable prints "<kernel> <calls> <picoseconds per call>" lines
+# (see probe_driver.c), and runs with <VAR> set to <value> if given. The
+# overhead of a backend is its time per call minus the baseline's: one
+# instrumented call runs the begin and the end probe.
+
+# Runs an executable and sets <prefix>_<kernel> to its picoseconds per call
+# for each kernel, and <prefix>_kernels to the kernel names
+function(_probe_run prefix executable)
+  execute_process(COMMAND ${executable}
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE status)
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "${executable} failed: ${status}")
+  endif()
+  string(REPLACE "\n" ";" lines "${output}")
+  set(kernels "")
+  foreach(line IN LISTS lines)
+    if(line MATCHES "^([a-z]+) ([0-9]+) ([0-9]+)$")
+      list(APPEND kernels ${CMAKE_MATCH_1})
+      set(${prefix}_${CMAKE_MATCH_1} ${CMAKE_MATCH_3} PARENT_SCOPE)
+    endif()
+  endforeach()
+  if(NOT kernels)
+    message(FATAL_ERROR "${executable} printed no timings:\n${output}")
+  endif()
+  set(${prefix}_kernels ${kernels} PARENT_SCOPE)
+endfunction()
+
+# Formats picoseconds as nanoseconds with three decimals
+function(_probe_ns out ps)
+  set(sign "")
+  if(ps LESS 0)
+    set(sign "-")
+    math(EXPR ps "-(${ps})")
+  endif()
+  math(EXPR whole "${ps} / 1000")
+  math(EXPR frac "${ps} % 1000 + 1000")
+  string(SUBSTRING "${frac}" 1 3 frac)
+  set(${out} "${sign}${whole}.${frac}" PARENT_SCOPE)
+endfunction()
+
+function(_probe_cell out text width)
+  string(LENGTH "${text}" length)
+  math(EXPR pad "${width} - ${length}")
+  if(pad GREATER 0)
+    string(REPEAT " " ${pad} spaces)
+    set(text "${spaces}${text}")
+  endif()
+  set(${out} "${text}" PARENT_SCOPE)
+endfunction()
+
+if(NOT BASELINE OR NOT VARIANTS)
+  message(FATAL_ERROR "Usage: cmake -DBASELINE=<exe> -DVARIANTS=<name>:<stub|real>:<exe>[|<VAR>=<value>],... -P ${CMAKE_CURRENT_LIST_FILE}")
+endif()
+
+_probe_run(base ${BASELINE})
+
+set(header "backend               library")
+foreach(kernel IN LISTS base_kernels)
+  _probe_cell(cell ${kernel} 12)
+  string(APPEND header "${cell}")
+endforeach()
+set(row "baseline              -      ")
+foreach(kernel IN LISTS base_kernels)
+  _probe_ns(ns ${base_${kernel}})
+  _probe_cell(cell ${ns} 12)
+  string(APPEND row "${cell}")
+endforeach()
+set(table "${header}\n${row}\n")
+set(json_backends "")
+
+string(REPLACE "," ";" VARIANTS "${VARIANTS}")
+foreach(variant IN LISTS VARIANTS)
+  if(NOT variant MATCHES "^([^:]+):([^:]+):(.+)$")
+    message(FATAL_ERROR "Malformed variant '${variant}'")
+  endif()
+  set(name ${CMAKE_MATCH_1})
+  set(library ${CMAKE_MATCH_2})
+  set(executable ${CMAKE_MATCH_3})
+  set(env_var "")
+  if(executable MATCHES "^(.+)\\|([A-Za-z_][A-Za-z0-9_]*)=(.*)$")
+    set(executable ${CMAKE_MATCH_1})
+    set(env_var ${CMAKE_MATCH_2})
+    set(ENV{${env_var}} "${CMAKE_MATCH_3}")
+  endif()
+  _probe_run(run ${executable})
+  if(env_var)
+    unset(ENV{${env_var}})
+  endif()
+
+  string(LENGTH "${name}" length)
+  math(EXPR pad "22 - ${length}")
+  string(REPEAT " " ${pad} spaces)
+  set(row "${name}${spaces}${library}")
+  string(LENGTH "${library}" length)
+  math(EXPR pad "7 - ${length}")
+  if(pad GREATER 0)
+    string(REPEAT " " ${pad} spaces)
+    string(APPEND row "${spaces}")
+  endif()
+  set(json_kernels "")
+  foreach(kernel IN LISTS base_kernels)
+    math(EXPR delta "${run_${kernel}} - ${base_${kernel}}")
+    _probe_ns(ns ${delta})
+    _probe_cell(cell ${ns} 12)
+    string(APPEND row "${cell}")
+    list(APPEND json_kernels "\"${kernel}\": ${ns}")
+  endforeach()
+  string(APPEND table "${row}\n")
+  list(JOIN json_kernels ", " json_kernels)
+  list(APPEND json_backends
+    "    {\"backend\": \"${name}\", \"library\": \"${library}\", \"overhead_ns\": {${json_kernels}}}")
+endforeach()
+
+message(STATUS "SALT-FM probe overhead, ns per instrumented call "
+  "(begin + end probe) over the uninstrumented build; baseline row is ns per call\n${table}")
+
+if(JSON)
+  set(json_baseline "")
+  foreach(kernel IN LISTS base_kernels)
+    _probe_ns(ns ${base_${kernel}})
+    list(APPEND json_baseline "\"${kernel}\": ${ns}")
+  endforeach()
+  list(JOIN json_baseline ", " json_baseline)
+  list(JOIN json_backends ",\n" json_backends)
+  file(WRITE ${JSON}
+    "{\n  \"baseline_ns\": {${json_baseline}},\n  \"backends\": [\n${json_backends}\n  ]\n}\n")
+endif()
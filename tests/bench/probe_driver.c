@@ -0,0 +1,86 @@
+/* Driver of the probe overhead benchmark. Times each kernel of
+ * probe_kernels.c, best of PROBE_REPEATS runs, and prints one line per
+ * kernel:
+ *
+ *     <kernel> <calls> <picoseconds per call>
+ *
+ * tests/bench/probe_bench_report.cmake subtracts the uninstrumented build's
+ * numbers from each instrumented build's. This file is never instrumented.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <time.h>
+
+#include "probe_kernels.h"
+
+#define PROBE_REPEATS 5
+#define PROBE_FIB_N 27
+#define PROBE_LEAF_ITERATIONS 2000000L
+#define PROBE_CHAIN_WALKS 100000L
+
+volatile long probe_sink;
+
+static long long probe_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long probe_fib_calls(int n)
+{
+    long before = 1, calls = 1;
+    for (int i = 2; i <= n; i++)
+    {
+        long next = calls + before + 1;
+        before = calls;
+        calls = next;
+    }
+    return calls;
+}
+
+static void probe_run_fib(void)
+{
+    probe_sink = probe_fib(PROBE_FIB_N);
+}
+
+static void probe_run_leaf(void)
+{
+    probe_sink = probe_leaf_loop(PROBE_LEAF_ITERATIONS);
+}
+
+static void probe_run_chain(void)
+{
+    for (long i = 0; i < PROBE_CHAIN_WALKS; i++)
+    {
+        probe_sink = probe_chain0(i);
+    }
+}
+
+static void probe_report(const char *kernel, void (*run)(void), long calls)
+{
+    long long best = -1;
+    for (int r = 0; r < PROBE_REPEATS; r++)
+    {
+        long long start = probe_now_ns();
+        run();
+        long long elapsed = probe_now_ns() - start;
+        if (best < 0 || elapsed < best)
+        {
+            best = elapsed;
+        }
+    }
+    printf("%s %ld %lld\n", kernel, calls, best * 1000 / calls);
+}
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+    probe_report("recursive", probe_run_fib, probe_fib_calls(PROBE_FIB_N));
+    probe_report("leaf", probe_run_leaf, PROBE_LEAF_ITERATIONS + 1);
+    probe_report("chain", probe_run_chain, PROBE_CHAIN_WALKS * PROBE_CHAIN_DEPTH);
+    return 0;
+}
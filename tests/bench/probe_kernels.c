@@ -0,0 +1,53 @@
+/* Micro-kernels for the probe overhead benchmark (the probe-bench target).
+ * This is the only file of the benchmark that SALT-FM instruments, once per
+ * shipped config; probe_driver.c times the kernels and is never instrumented.
+ *
+ * Every kernel function is kept out of line so that the uninstrumented
+ * baseline makes the same calls as the instrumented builds.
+ */
+
+#include "probe_kernels.h"
+
+/* Tight recursion: fib(n) makes probe_fib_calls(n) calls */
+PROBE_NOINLINE long probe_fib(int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+    return probe_fib(n - 1) + probe_fib(n - 2);
+}
+
+/* Small leaf function, called once per iteration of probe_leaf_loop */
+PROBE_NOINLINE long probe_leaf(long a, long b)
+{
+    return a + b;
+}
+
+PROBE_NOINLINE long probe_leaf_loop(long iterations)
+{
+    long sum = 0;
+    for (long i = 0; i < iterations; i++)
+    {
+        sum = probe_leaf(sum, i);
+    }
+    return sum;
+}
+
+/* Deep call chain: probe_chain0 -> ... -> probe_chain15, PROBE_CHAIN_DEPTH calls per walk */
+PROBE_NOINLINE long probe_chain15(long x) { return x + 15; }
+PROBE_NOINLINE long probe_chain14(long x) { return probe_chain15(x) + 14; }
+PROBE_NOINLINE long probe_chain13(long x) { return probe_chain14(x) + 13; }
+PROBE_NOINLINE long probe_chain12(long x) { return probe_chain13(x) + 12; }
+PROBE_NOINLINE long probe_chain11(long x) { return probe_chain12(x) + 11; }
+PROBE_NOINLINE long probe_chain10(long x) { return probe_chain11(x) + 10; }
+PROBE_NOINLINE long probe_chain9(long x) { return probe_chain10(x) + 9; }
+PROBE_NOINLINE long probe_chain8(long x) { return probe_chain9(x) + 8; }
+PROBE_NOINLINE long probe_chain7(long x) { return probe_chain8(x) + 7; }
+PROBE_NOINLINE long probe_chain6(long x) { return probe_chain7(x) + 6; }
+PROBE_NOINLINE long probe_chain5(long x) { return probe_chain6(x) + 5; }
+PROBE_NOINLINE long probe_chain4(long x) { return probe_chain5(x) + 4; }
+PROBE_NOINLINE long probe_chain3(long x) { return probe_chain4(x) + 3; }
+PROBE_NOINLINE long probe_chain2(long x) { return probe_chain3(x) + 2; }
+PROBE_NOINLINE long probe_chain1(long x) { return probe_chain2(x) + 1; }
+PROBE_NOINLINE long probe_chain0(long x) { return probe_chain1(x); }
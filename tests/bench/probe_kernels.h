@@ -0,0 +1,19 @@
+/* Kernels of the probe overhead benchmark, see probe_kernels.c */
+
+#ifndef PROBE_KERNELS_H
+#define PROBE_KERNELS_H
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PROBE_NOINLINE __attribute__((noinline))
+#else
+#define PROBE_NOINLINE
+#endif
+
+#define PROBE_CHAIN_DEPTH 16
+
+long probe_fib(int n);
+long probe_leaf(long a, long b);
+long probe_leaf_loop(long iterations);
+long probe_chain0(long x);
+
+#endif /* PROBE_KERNELS_H */
@@ -0,0 +1,45 @@
+/* TAU stub for the probe-bench target, see probe_stubs.h.
+ * Like TAU, TAU_PROFILE_TIMER creates its timer once and keeps it in a
+ * function-local static, and C++'s TAU_PROFILE stops its timer when the
+ * enclosing block exits.
+ */
+
+#ifndef PROBE_STUB_TAU_PROFILER_H
+#define PROBE_STUB_TAU_PROFILER_H
+
+#include "probe_stubs.h"
+
+#define TAU_USER 0
+#define TAU_DEFAULT 0
+
+#define TAU_PROFILE_TIMER(var, name, type, group)                                                                      \
+    static void *var##_handle;                                                                                         \
+    void *var = var##_handle ? var##_handle : (var##_handle = salt_stub_timer_create(name))
+#define TAU_PROFILE_START(var) salt_stub_timer_start(var)
+#define TAU_PROFILE_STOP(var) salt_stub_timer_stop(var)
+#define TAU_INIT(argc, argv) salt_stub_init()
+#define TAU_PROFILE_SET_NODE(node) ((void)(node))
+
+#ifdef __cplusplus
+class salt_stub_scoped_timer
+{
+  public:
+    explicit salt_stub_scoped_timer(void *timer) : timer(timer)
+    {
+        salt_stub_timer_start(timer);
+    }
+    ~salt_stub_scoped_timer()
+    {
+        salt_stub_timer_stop(timer);
+    }
+
+  private:
+    void *timer;
+};
+
+#define TAU_PROFILE(name, type, group)                                                                                 \
+    static void *salt_stub_scope_handle = salt_stub_timer_create(name);                                                \
+    salt_stub_scoped_timer salt_stub_scope(salt_stub_scope_handle)
+#endif
+
+#endif /* PROBE_STUB_TAU_PROFILER_H */
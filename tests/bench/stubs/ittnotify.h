@@ -0,0 +1,11 @@
+/* ITT stub for the probe-bench target, see probe_stubs.h.
+ * config_files/itt_config.yaml includes <ittnotify.h> but inserts the
+ * PerfStubs timer macros, so this stub provides those.
+ */
+
+#ifndef PROBE_STUB_ITTNOTIFY_H
+#define PROBE_STUB_ITTNOTIFY_H
+
+#include "perfstubs_api/timer.h"
+
+#endif /* PROBE_STUB_ITTNOTIFY_H */
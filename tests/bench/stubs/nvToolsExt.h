@@ -0,0 +1,34 @@
+/* NVTX stub for the probe-bench target, see probe_stubs.h. Registered
+ * strings are timer handles, so pushing one costs a start.
+ */
+
+#ifndef PROBE_STUB_NVTOOLSEXT_H
+#define PROBE_STUB_NVTOOLSEXT_H
+
+#include <stdint.h>
+
+#include "probe_stubs.h"
+
+#define NVTX_VERSION 2
+#define NVTX_MESSAGE_TYPE_REGISTERED 3
+#define NVTX_EVENT_ATTRIB_STRUCT_SIZE ((uint16_t)sizeof(nvtxEventAttributes_t))
+
+typedef void *nvtxDomainHandle_t;
+typedef void *nvtxStringHandle_t;
+
+typedef struct nvtxEventAttributes_t {
+    uint16_t version;
+    uint16_t size;
+    int32_t messageType;
+    union {
+        const char *ascii;
+        nvtxStringHandle_t registered;
+    } message;
+} nvtxEventAttributes_t;
+
+#define nvtxRangePushA(name) salt_stub_range_push(name)
+#define nvtxRangePop() salt_stub_range_pop()
+#define nvtxDomainRegisterStringA(domain, name) salt_stub_timer_create(name)
+#define nvtxDomainRangePushEx(domain, attributes) salt_stub_timer_start((attributes)->message.registered)
+
+#endif /* PROBE_STUB_NVTOOLSEXT_H */
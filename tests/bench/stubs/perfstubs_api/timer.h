@@ -0,0 +1,25 @@
+/* PerfStubs stub for the probe-bench target, see probe_stubs.h.
+ * Like PerfStubs, PERFSTUBS_TIMER_START_FUNC creates the timer of the
+ * enclosing function once and keeps it in a function-local static, and
+ * PERFSTUBS_TIMER_START does so for a timer named by its caller.
+ */
+
+#ifndef PROBE_STUB_PERFSTUBS_TIMER_H
+#define PROBE_STUB_PERFSTUBS_TIMER_H
+
+#include "probe_stubs.h"
+
+#define PERFSTUBS_INITIALIZE() salt_stub_init()
+#define PERFSTUBS_TIMER_START_FUNC(timer)                                                                              \
+    static void *timer##_handle;                                                                                       \
+    void *timer = timer##_handle ? timer##_handle : (timer##_handle = salt_stub_timer_create(__func__));              \
+    salt_stub_timer_start(timer)
+#define PERFSTUBS_TIMER_STOP_FUNC(timer) salt_stub_timer_stop(timer)
+#define PERFSTUBS_TIMER_START(timer, name)                                                                             \
+    static void *timer;                                                                                                \
+    if (!timer)                                                                                                        \
+        timer = salt_stub_timer_create(name);                                                                          \
+    salt_stub_timer_start(timer)
+#define PERFSTUBS_TIMER_STOP(timer) salt_stub_timer_stop(timer)
+
+#endif /* PROBE_STUB_PERFSTUBS_TIMER_H */
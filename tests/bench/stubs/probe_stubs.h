@@ -0,0 +1,26 @@
+/* Stand-ins for the profiling libraries of the shipped configs, used by
+ * the probe-bench target when a library is not installed. Each probe is an
+ * out-of-line call into probe_stubs.c, which does no more than count, so a
+ * stub build measures what the inserted call sites cost: the call, its
+ * arguments and the static timer handle, but not the library's bookkeeping.
+ */
+
+#ifndef PROBE_STUBS_H
+#define PROBE_STUBS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *salt_stub_timer_create(const char *name);
+void salt_stub_timer_start(void *timer);
+void salt_stub_timer_stop(void *timer);
+void salt_stub_range_push(const char *name);
+void salt_stub_range_pop(void);
+void salt_stub_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROBE_STUBS_H */
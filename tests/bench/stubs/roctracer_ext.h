@@ -0,0 +1,11 @@
+/* ROCTX stub for the probe-bench target, see probe_stubs.h */
+
+#ifndef PROBE_STUB_ROCTRACER_EXT_H
+#define PROBE_STUB_ROCTRACER_EXT_H
+
+#include "probe_stubs.h"
+
+#define roctxRangePush(name) salt_stub_range_push(name)
+#define roctxRangePop() salt_stub_range_pop()
+
+#endif /* PROBE_STUB_ROCTRACER_EXT_H */
@@ -0,0 +1,22 @@
+#include <stdio.h>
+
+long solve_first(long n)
+{
+    return n + 1;
+}
+
+long solve_second(long n)
+{
+    return n * 2;
+}
+
+long helper(long n)
+{
+    return n - 1;
+}
+
+int main(void)
+{
+    printf("result %ld\n", helper(solve_first(1)) + solve_second(2));
+    return 0;
+}
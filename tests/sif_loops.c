@@ -0,0 +1,38 @@
+#include <stdio.h>
+
+int find_first(const int *values, int count, int target)
+{
+    for (int i = 0; i < count; i++) {
+        if (values[i] == target) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+long sum_rows(int rows, int cols)
+{
+    long sum = 0;
+    int row = 0;
+    while (row < rows) {
+        for (int col = 0; col < cols; col++)
+            sum += row * col;
+        row++;
+    }
+    return sum;
+}
+
+void untouched(int n)
+{
+    for (int i = 0; i < n; i++) {
+        printf("%d\n", i);
+    }
+}
+
+int main(void)
+{
+    int values[] = {3, 1, 4, 1, 5};
+    untouched(2);
+    printf("%d %ld\n", find_first(values, 5, 4), sum_rows(3, 4));
+    return 0;
+}
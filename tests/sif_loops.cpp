@@ -0,0 +1,40 @@
+#include <cstdio>
+#include <vector>
+
+int find_pair(const std::vector<int> &values, int sum)
+{
+    for (std::size_t i = 0; i < values.size(); i++) {
+        for (std::size_t j = i + 1; j < values.size(); j++) {
+            if (values[i] + values[j] == sum) {
+                return static_cast<int>(i * values.size() + j);
+            }
+        }
+    }
+    return -1;
+}
+
+long total(const std::vector<int> &values)
+{
+    long sum = 0;
+    for (int value : values) {
+        sum += value;
+    }
+    return sum;
+}
+
+int halvings(int n)
+{
+    int steps = 0;
+    do {
+        n /= 2;
+        steps++;
+    } while (n > 0);
+    return steps;
+}
+
+int main()
+{
+    std::vector<int> values = {3, 1, 4, 1, 5};
+    std::printf("%d %ld %d\n", find_pair(values, 9), total(values), halvings(40));
+    return 0;
+}